@@ -15,6 +15,20 @@
 // CPU-RAM   = 1110
 // CARTRAM   = 1111
 
+// Mapper families. Each mapper instance below is in one of them. The simulator
+// can build a model with only some families (verilator/Makefile MAPPERS=...) by
+// defining CART_ONLY and the families it wants. Otherwise all of them are built.
+// CART_MAP28: 0, 2, 3, 7, 28, 94, 97, 180, 185 (NROM, UxROM, CNROM, AxROM, ...)
+// CART_MMC1:  1, 155, 171
+// CART_MMC3:  4 and the MMC3 variants handled by the mmc3 instance
+// CART_OTHER: everything else, including expansion audio and the NSF player
+`ifndef CART_ONLY
+`define CART_MAP28
+`define CART_MMC1
+`define CART_MMC3
+`define CART_OTHER
+`endif
+
 module cart_top (
 	input             clk,
 	input             ce,
@@ -61,6 +75,7 @@ tri0 [21:0] prg_addr_b, chr_addr_b;
 tri0 [15:0] flags_out_b, audio_out_b;
 tri1 [7:0] prg_dout_b, chr_dout_b;
 
+`ifdef CART_OTHER
 // This mapper used to be default if no other mapper was found
 // It seems MMC0 is handled by map28. Does it have any purpose?
 // flags_out_b will be high if no other mappers are selected, so we use that.
@@ -88,7 +103,9 @@ MMC0 mmc0(
 	.audio_in   (audio_in),
 	.audio_b    (audio_out_b)
 );
+`endif
 
+`ifdef CART_MMC1
 //*****************************************************************************//
 // Name   : MMC1                                                               //
 // Mappers: 1, 155, 171 (hard wired vertical mirroring)                        //
@@ -119,7 +136,9 @@ MMC1 mmc1(
 	.audio_in   (audio_in),
 	.audio_b    (audio_out_b)
 );
+`endif
 
+`ifdef CART_MAP28
 //*****************************************************************************//
 // Name   : Tepples                                                            //
 // Mappers: 0, 2, 3, 7, 28, 94, 97, 180, 185                                   //
@@ -152,7 +171,9 @@ Mapper28 map28(
 	.audio_in   (audio_in),
 	.audio_b    (audio_out_b)
 );
+`endif
 
+`ifdef CART_OTHER
 //*****************************************************************************//
 // Name   : UNROM 512                                                          //
 // Mappers: 30                                                                 //
@@ -245,7 +266,9 @@ MMC2 mmc2(
 	.audio_in   (audio_in),
 	.audio_b    (audio_out_b)
 );
+`endif
 
+`ifdef CART_MMC3
 //*****************************************************************************//
 // Name   : MMC3                                                               //
 // Mappers: 4, 33, 37, 47, 48, 74, 76, 80, 82, 88, 95, 112, 118, 119, 154, 191,//
@@ -281,7 +304,9 @@ MMC3 mmc3 (
 	.audio_in   (audio_in),
 	.audio_b    (audio_out_b)
 );
+`endif
 
+`ifdef CART_OTHER
 //*****************************************************************************//
 // Name   : MMC4                                                               //
 // Mappers: 10                                                                 //
@@ -1213,29 +1238,33 @@ NesEvent nesev(
 // Notes  :                                                                    //
 // Games  : King Kong 2, Exciting Boxing, Tetsuwan Atom                        //
 //*****************************************************************************//
-// VRC1 vrc1(
-// 	.clk        (clk),
-// 	.ce         (ce),
-// 	.enable     (me[75]),
-// 	.flags      (flags),
-// 	.prg_ain    (prg_ain),
-// 	.prg_aout_b (prg_addr_b),
-// 	.prg_read   (prg_read),
-// 	.prg_write  (prg_write),
-// 	.prg_din    (prg_din),
-// 	.prg_dout_b (prg_dout_b),
-// 	.prg_allow_b(prg_allow_b),
-// 	.chr_ain    (chr_ain),
-// 	.chr_aout_b (chr_addr_b),
-// 	.chr_read   (chr_read),
-// 	.chr_allow_b(chr_allow_b),
-// 	.vram_a10_b (vram_a10_b),
-// 	.vram_ce_b  (vram_ce_b),
-// 	.irq_b      (irq_b),
-// 	.flags_out_b(flags_out_b),
-// 	.audio_in   (audio_in),
-// 	.audio_b    (audio_out_b)
-// );
+// The Konami VRC mappers are left out of the FPGA build to save logic.
+// The Verilator sim builds them so these carts can be simulated.
+`ifdef VERILATOR
+VRC1 vrc1(
+	.clk        (clk),
+	.ce         (ce),
+	.enable     (me[75]),
+	.flags      (flags),
+	.prg_ain    (prg_ain),
+	.prg_aout_b (prg_addr_b),
+	.prg_read   (prg_read),
+	.prg_write  (prg_write),
+	.prg_din    (prg_din),
+	.prg_dout_b (prg_dout_b),
+	.prg_allow_b(prg_allow_b),
+	.chr_ain    (chr_ain),
+	.chr_aout_b (chr_addr_b),
+	.chr_read   (chr_read),
+	.chr_allow_b(chr_allow_b),
+	.vram_a10_b (vram_a10_b),
+	.vram_ce_b  (vram_ce_b),
+	.irq_b      (irq_b),
+	.flags_out_b(flags_out_b),
+	.audio_in   (audio_in),
+	.audio_b    (audio_out_b)
+);
+`endif
 
 //*****************************************************************************//
 // Name   : Konami VRC-3                                                       //
@@ -1244,29 +1273,31 @@ NesEvent nesev(
 // Notes  :                                                                    //
 // Games  : Salamander (j)                                                     //
 //*****************************************************************************//
-// VRC3 vrc3(
-// 	.clk        (clk),
-// 	.ce         (ce),
-// 	.enable     (me[73]),
-// 	.flags      (flags),
-// 	.prg_ain    (prg_ain),
-// 	.prg_aout_b (prg_addr_b),
-// 	.prg_read   (prg_read),
-// 	.prg_write  (prg_write),
-// 	.prg_din    (prg_din),
-// 	.prg_dout_b (prg_dout_b),
-// 	.prg_allow_b(prg_allow_b),
-// 	.chr_ain    (chr_ain),
-// 	.chr_aout_b (chr_addr_b),
-// 	.chr_read   (chr_read),
-// 	.chr_allow_b(chr_allow_b),
-// 	.vram_a10_b (vram_a10_b),
-// 	.vram_ce_b  (vram_ce_b),
-// 	.irq_b      (irq_b),
-// 	.flags_out_b(flags_out_b),
-// 	.audio_in   (audio_in),
-// 	.audio_b    (audio_out_b)
-// );
+`ifdef VERILATOR
+VRC3 vrc3(
+	.clk        (clk),
+	.ce         (ce),
+	.enable     (me[73]),
+	.flags      (flags),
+	.prg_ain    (prg_ain),
+	.prg_aout_b (prg_addr_b),
+	.prg_read   (prg_read),
+	.prg_write  (prg_write),
+	.prg_din    (prg_din),
+	.prg_dout_b (prg_dout_b),
+	.prg_allow_b(prg_allow_b),
+	.chr_ain    (chr_ain),
+	.chr_aout_b (chr_addr_b),
+	.chr_read   (chr_read),
+	.chr_allow_b(chr_allow_b),
+	.vram_a10_b (vram_a10_b),
+	.vram_ce_b  (vram_ce_b),
+	.irq_b      (irq_b),
+	.flags_out_b(flags_out_b),
+	.audio_in   (audio_in),
+	.audio_b    (audio_out_b)
+);
+`endif
 
 //*****************************************************************************//
 // Name   : Konami VRC2/4                                                      //
@@ -1275,29 +1306,31 @@ NesEvent nesev(
 // Notes  :                                                                    //
 // Games  : Wai Wai World 2, Twinbee 3, Contra (j), Gradius II (j)             //
 //*****************************************************************************//
-// VRC24 vrc24(
-// 	.clk        (clk),
-// 	.ce         (ce),
-// 	.enable     (me[21] | me[22] | me[23] | me[25] | me[27]),
-// 	.flags      (flags),
-// 	.prg_ain    (prg_ain),
-// 	.prg_aout_b (prg_addr_b),
-// 	.prg_read   (prg_read),
-// 	.prg_write  (prg_write),
-// 	.prg_din    (prg_din),
-// 	.prg_dout_b (prg_dout_b),
-// 	.prg_allow_b(prg_allow_b),
-// 	.chr_ain    (chr_ain),
-// 	.chr_aout_b (chr_addr_b),
-// 	.chr_read   (chr_read),
-// 	.chr_allow_b(chr_allow_b),
-// 	.vram_a10_b (vram_a10_b),
-// 	.vram_ce_b  (vram_ce_b),
-// 	.irq_b      (irq_b),
-// 	.flags_out_b(flags_out_b),
-// 	.audio_in   (audio_in),
-// 	.audio_b    (audio_out_b)
-// );
+`ifdef VERILATOR
+VRC24 vrc24(
+	.clk        (clk),
+	.ce         (ce),
+	.enable     (me[21] | me[22] | me[23] | me[25] | me[27]),
+	.flags      (flags),
+	.prg_ain    (prg_ain),
+	.prg_aout_b (prg_addr_b),
+	.prg_read   (prg_read),
+	.prg_write  (prg_write),
+	.prg_din    (prg_din),
+	.prg_dout_b (prg_dout_b),
+	.prg_allow_b(prg_allow_b),
+	.chr_ain    (chr_ain),
+	.chr_aout_b (chr_addr_b),
+	.chr_read   (chr_read),
+	.chr_allow_b(chr_allow_b),
+	.vram_a10_b (vram_a10_b),
+	.vram_ce_b  (vram_ce_b),
+	.irq_b      (irq_b),
+	.flags_out_b(flags_out_b),
+	.audio_in   (audio_in),
+	.audio_b    (audio_out_b)
+);
+`endif
 
 //*****************************************************************************//
 // Name   : Konami VRC-6                                                       //
@@ -1306,29 +1339,31 @@ NesEvent nesev(
 // Notes  : External audio needs to be mixed correctly.                        //
 // Games  : Akamajou Densetsu, Esper Dream 2, Mouryou Senki Madara             //
 //*****************************************************************************//
-// VRC6 vrc6(
-// 	.clk        (clk),
-// 	.ce         (ce),
-// 	.enable     (me[24] | me[26]),
-// 	.flags      (flags),
-// 	.prg_ain    (prg_ain),
-// 	.prg_aout_b (prg_addr_b),
-// 	.prg_read   (prg_read),
-// 	.prg_write  (prg_write),
-// 	.prg_din    (prg_din),
-// 	.prg_dout_b (prg_dout_b),
-// 	.prg_allow_b(prg_allow_b),
-// 	.chr_ain    (chr_ain),
-// 	.chr_aout_b (chr_addr_b),
-// 	.chr_read   (chr_read),
-// 	.chr_allow_b(chr_allow_b),
-// 	.vram_a10_b (vram_a10_b),
-// 	.vram_ce_b  (vram_ce_b),
-// 	.irq_b      (irq_b),
-// 	.flags_out_b(flags_out_b),
-// 	.audio_in   (vrc6_audio),
-// 	.audio_b    (audio_out_b)
-// );
+`ifdef VERILATOR
+VRC6 vrc6(
+	.clk        (clk),
+	.ce         (ce),
+	.enable     (me[24] | me[26]),
+	.flags      (flags),
+	.prg_ain    (prg_ain),
+	.prg_aout_b (prg_addr_b),
+	.prg_read   (prg_read),
+	.prg_write  (prg_write),
+	.prg_din    (prg_din),
+	.prg_dout_b (prg_dout_b),
+	.prg_allow_b(prg_allow_b),
+	.chr_ain    (chr_ain),
+	.chr_aout_b (chr_addr_b),
+	.chr_read   (chr_read),
+	.chr_allow_b(chr_allow_b),
+	.vram_a10_b (vram_a10_b),
+	.vram_ce_b  (vram_ce_b),
+	.irq_b      (irq_b),
+	.flags_out_b(flags_out_b),
+	.audio_in   (vrc6_audio),
+	.audio_b    (audio_out_b)
+);
+`endif
 
 //*****************************************************************************//
 // Name   : Konami VRC-7                                                       //
@@ -1337,29 +1372,31 @@ NesEvent nesev(
 // Notes  : Audio mixing needs evaluation                                      //
 // Games  : Lagrange Point, Tiny Toon Aventures 2 (j)                          //
 //*****************************************************************************//
-// VRC7 vrc7(
-// 	.clk        (clk),
-// 	.ce         (ce),
-// 	.enable     (me[85]),
-// 	.flags      (flags),
-// 	.prg_ain    (prg_ain),
-// 	.prg_aout_b (prg_addr_b),
-// 	.prg_read   (prg_read),
-// 	.prg_write  (prg_write),
-// 	.prg_din    (prg_din),
-// 	.prg_dout_b (prg_dout_b),
-// 	.prg_allow_b(prg_allow_b),
-// 	.chr_ain    (chr_ain),
-// 	.chr_aout_b (chr_addr_b),
-// 	.chr_read   (chr_read),
-// 	.chr_allow_b(chr_allow_b),
-// 	.vram_a10_b (vram_a10_b),
-// 	.vram_ce_b  (vram_ce_b),
-// 	.irq_b      (irq_b),
-// 	.flags_out_b(flags_out_b),
-// 	.audio_in   (vrc7_audio),
-// 	.audio_b    (audio_out_b)
-// );
+`ifdef VERILATOR
+VRC7 vrc7(
+	.clk        (clk),
+	.ce         (ce),
+	.enable     (me[85]),
+	.flags      (flags),
+	.prg_ain    (prg_ain),
+	.prg_aout_b (prg_addr_b),
+	.prg_read   (prg_read),
+	.prg_write  (prg_write),
+	.prg_din    (prg_din),
+	.prg_dout_b (prg_dout_b),
+	.prg_allow_b(prg_allow_b),
+	.chr_ain    (chr_ain),
+	.chr_aout_b (chr_addr_b),
+	.chr_read   (chr_read),
+	.chr_allow_b(chr_allow_b),
+	.vram_a10_b (vram_a10_b),
+	.vram_ce_b  (vram_ce_b),
+	.irq_b      (irq_b),
+	.flags_out_b(flags_out_b),
+	.audio_in   (vrc7_audio),
+	.audio_b    (audio_out_b)
+);
+`endif
 
 //*****************************************************************************//
 // Name   : Namco 163                                                          //
@@ -1820,29 +1857,34 @@ wire [7:0] fds_data;
 // );
 
 wire [15:0] vrc7_audio;
-// vrc7_mixed snd_vrc7 (
-// 	.clk(clk),
-// 	.ce(ce),
-// 	.enable(me[85] | (me[31] && exp_audioe[1])),
-// 	.wren(prg_write),
-// 	.addr_in(prg_ain),
-// 	.data_in(prg_din),
-// 	.audio_in(audio_in),
-// 	.audio_out(vrc7_audio)
-// );
+`ifdef VERILATOR
+vrc7_mixed snd_vrc7 (
+	.clk(clk),
+	.ce(ce),
+	.enable(me[85] | (me[31] && exp_audioe[1])),
+	.wren(prg_write),
+	.addr_in(prg_ain),
+	.data_in(prg_din),
+	.audio_in(audio_in),
+	.audio_out(vrc7_audio)
+);
+`endif
 
 wire [15:0] vrc6_audio;
-// vrc6_mixed snd_vrc6 (
-// 	.clk(clk),
-// 	.ce(ce),
-// 	.enable(me[24] | me[26] | (me[31] && exp_audioe[0])),
-// 	.wren(prg_write),
-// 	.addr_invert(me[26]),
-// 	.addr_in(prg_ain),
-// 	.data_in(prg_din),
-// 	.audio_in(audio_in),
-// 	.audio_out(vrc6_audio)
-// );
+`ifdef VERILATOR
+vrc6_mixed snd_vrc6 (
+	.clk(clk),
+	.ce(ce),
+	.enable(me[24] | me[26] | (me[31] && exp_audioe[0])),
+	.wren(prg_write),
+	.addr_invert(me[26]),
+	.addr_in(prg_ain),
+	.data_in(prg_din),
+	.audio_in(audio_in),
+	.audio_out(vrc6_audio)
+);
+`endif
+`endif // CART_OTHER
 
 
 reg [6:0] prg_mask;
@@ -1879,11 +1921,16 @@ always @* begin
 	{prg_aout,   prg_allow,   chr_aout,   vram_a10,   vram_ce,   chr_allow,   prg_dout,   chr_dout,   irq,   audio} =
 	{prg_addr_b, prg_allow_b, chr_addr_b, vram_a10_b, vram_ce_b, chr_allow_b, prg_dout_b, chr_dout_b, irq_b, audio_out_b};
 
+`ifdef CART_OTHER
 	// Currently only used for Mapper 16 EEPROM. Expand if needed.
 	{mapper_addr, mapper_data_out, mapper_prg_write, mapper_ovr} = (me[159] | me[16]) ?
 		{map16_mapper_addr, map16_data_out, map16_prg_write, map16_ovr} : 28'd0;
 
 	{diskside_auto} = {fds_diskside_auto};
+`else
+	{mapper_addr, mapper_data_out, mapper_prg_write, mapper_ovr} = 28'd0;
+	diskside_auto = 2'd0;
+`endif
 
 	// Behavior helper flags
 	{prg_conflict, prg_bus_write, has_chr_dout} = {flags_out_b[2], flags_out_b[1], flags_out_b[0]};
@@ -20,6 +20,10 @@ reg out_clk = 0;
 
 reg [1:0] cnt;
 
+// Set by the Verilator harness before reset when it has already written the ROM
+// into SDRAM and set mapper_flags. Loading then ends right away without streaming.
+reg preloaded /* verilator public */;
+
 always @(posedge clk) begin
     if (reset) begin
         state <= 0;
@@ -30,6 +34,9 @@ always @(posedge clk) begin
         state <= 1;
         downloading <= 1;
         cnt <= 0;
+    end else if (state==1 && preloaded) begin
+        state <= 2;
+        downloading <= 0;
     end else if (state==1) begin
         cnt <= cnt + 1;
         odata_clk <= 0;
@@ -1,5 +1,7 @@
 //Famicom Disk System
 
+/* verilator lint_off WIDTHTRUNC */
+
 module MapperFDS(
 	input        clk,         // System clock
 	input        ce,          // M2 ~cpu_clk
@@ -742,3 +744,5 @@ end // if m2
 end
 
 endmodule
+
+/* verilator lint_on WIDTHTRUNC */
@@ -1,5 +1,7 @@
 // Konami VRC Mappers
 
+/* verilator lint_off WIDTHTRUNC */
+
 // VRC1 (75)
 module VRC1(
 	input        clk,         // System clock
@@ -816,7 +818,13 @@ wire ack;
 wire ce_ym2143 = ce | (ce_count==4'd5);
 wire signed [13:0] ym2143audio;
 wire wr_audio = wren && (addr_in[15:6]==10'b1001_0000_00) && (addr_in[4:0]==5'b1_0000); //0x9010 or 0x9030
+`ifdef VERILATOR
+// The OPLL core (eseopll) is not in this tree, VRC7 games run without expansion audio in the sim
+assign ack = 1'b0;
+assign ym2143audio = 14'd0;
+`else
 eseopll ym2143vrc7 (clk,~enable, ce_ym2143,wr_audio,ce_ym2143,ack,wr_audio,{15'b0,addr_in[5]},data_in,ym2143audio);
+`endif
 
 // The strategy here:
 // VRC7 sound is very low, and the top bit is seldom (if ever) used. It's output as signed with
@@ -972,3 +980,4 @@ assign outSaw=ch2;
 
 endmodule
 
+/* verilator lint_on WIDTHTRUNC */
@@ -77,7 +77,7 @@ module NES(
 	input   [1:0] sys_type,
 	output  [2:0] nes_div,
 	input  [63:0] mapper_flags,
-	output [15:0] sample,         // sample generated from APU
+	output [15:0] sample /* verilator public */,  // sample generated from APU
 	output  [5:0] color /* verilator public */,          // pixel generated from PPU
 	output  [2:0] joypad_out,     // Set to 1 to strobe joypads. Then set to zero to keep the value (bit0)
 	output  [1:0] joypad_clock,   // Set to 1 for each joypad to clock it.
@@ -90,14 +90,14 @@ module NES(
 	input   [4:0] audio_channels, // Enabled audio channels
 
 	// Access signals for the SDRAM.
-	output [21:0] cpumem_addr,
-	output        cpumem_read,
-	output        cpumem_write,
+	output [21:0] cpumem_addr /* verilator public */,
+	output        cpumem_read /* verilator public */,
+	output        cpumem_write /* verilator public */,
 	output  [7:0] cpumem_dout,
 	input   [7:0] cpumem_din,
-	output [21:0] ppumem_addr,
-	output        ppumem_read,
-	output        ppumem_write,
+	output [21:0] ppumem_addr /* verilator public */,
+	output        ppumem_read /* verilator public */,
+	output        ppumem_write /* verilator public */,
 	output  [7:0] ppumem_dout,
 	input   [7:0] ppumem_din,
 
@@ -176,7 +176,7 @@ reg [2:0] div_ppu = 3'd1;
 reg [1:0] div_sys = 2'd0;
 
 // CE's
-wire cpu_ce  = (div_cpu == div_cpu_n);
+wire cpu_ce /* verilator public */ = (div_cpu == div_cpu_n);
 wire ppu_ce  = (div_ppu == div_ppu_n);
 wire cart_ce = (cart_pre & ppu_ce); // First PPU cycle where cpu data is visible.
 
@@ -257,10 +257,13 @@ end
 /*************              CPU             ***************/
 /**********************************************************/
 
-wire [15:0] cpu_addr;
-wire cpu_rnw;
-wire pause_cpu;
-wire nmi;
+wire [15:0] cpu_addr /* verilator public */;
+wire cpu_rnw /* verilator public */;
+wire cpu_sync /* verilator public */;      // opcode fetch cycle
+wire pause_cpu /* verilator public */;
+wire [7:0] cpu_din /* verilator public */;
+wire [63:0] cpu_regs /* verilator public */;   // {PC,S,P,Y,X,A}, for the simulator's CPU trace
+wire nmi /* verilator public */;
 wire mapper_irq;
 wire apu_irq;
 
@@ -282,15 +285,17 @@ T65 cpu(
 	.NMI_n  (~nmi),
 	.SO_n   (1'b1),
 	.R_W_n  (cpu_rnw),
-	.Sync(), .EF(), .MF(), .XF(), .ML_n(), .VP_n(), .VDA(), .VPA(),
+	.Sync(cpu_sync), .EF(), .MF(), .XF(), .ML_n(), .VP_n(), .VDA(), .VPA(),
 
 	.A      (cpu_addr),
-	.DI     (cpu_rnw ? from_data_bus : cpu_dout),
+	.DI     (cpu_din),
 	.DO     (cpu_dout),
 
-	.Regs(), .DEBUG(), .NMI_ack()
+	.Regs(cpu_regs), .DEBUG(), .NMI_ack()
 );
 
+assign cpu_din = cpu_rnw ? from_data_bus : cpu_dout;
+
 wire [15:0] dma_aout;
 wire dma_aout_enable;
 wire dma_read;
@@ -299,10 +304,10 @@ wire apu_dma_request, apu_dma_ack;
 wire [15:0] apu_dma_addr;
 
 // Determine the values on the bus outgoing from the CPU chip (after DMA / APU)
-wire [15:0] addr = dma_aout_enable ? dma_aout  : cpu_addr;
+wire [15:0] addr /* verilator public */ = dma_aout_enable ? dma_aout  : cpu_addr;
 wire [7:0]  dbus = dma_aout_enable ? dma_data_to_ram : cpu_dout;
 wire mr_int      = dma_aout_enable ? dma_read  : cpu_rnw;
-wire mw_int      = dma_aout_enable ? !dma_read : !cpu_rnw;
+wire mw_int /* verilator public */ = dma_aout_enable ? !dma_read : !cpu_rnw;
 
 DmaController dma(
 	.clk            (clk),
@@ -528,6 +533,17 @@ assign ppumem_read  = chr_read;
 assign ppumem_write = chr_write && (chr_allow || vram_ce);
 assign ppumem_dout  = chr_from_ppu;
 
+`ifdef VERILATOR
+// SDRAM address of each 1KB of the pattern tables, as the PPU last fetched it.
+// Read by the simulator's PPU viewers (verilator/ppuview.h).
+reg [11:0] chr_bank_map[0:7] /* verilator public */;
+integer bank;
+initial for (bank = 0; bank < 8; bank = bank + 1) chr_bank_map[bank] = 12'h800 + bank[11:0];   // CHR at $200000
+always @(posedge clk)
+	if (chr_read && !vram_ce && !chr_addr[13])
+		chr_bank_map[chr_addr[12:10]] <= chr_linaddr[21:10];
+`endif
+
 reg [7:0] open_bus_data;
 
 always @(posedge clk) begin
@@ -240,12 +240,14 @@ hdmi( .clk_pixel_x5(clk_5x_pixel),
         .frame_width( frameWidth ),
         .frame_height( frameHeight ) );
 
+`ifndef VERILATOR
 // Gowin LVDS output buffer
 ELVDS_OBUF tmds_bufds [3:0] (
     .I({clk_pixel, tmds}),
     .O({tmds_clk_p, tmds_d_p}),
     .OB({tmds_clk_n, tmds_d_n})
 );
+`endif
 
 // 2C02 palette: https://www.nesdev.org/wiki/PPU_palettes
 assign NES_PALETTE[0] = 24'h545454;  assign NES_PALETTE[1] = 24'h001e74;  assign NES_PALETTE[2] = 24'h081090;  assign NES_PALETTE[3] = 24'h300088;  
@@ -9,6 +9,9 @@ import configPackage::*;
 
 module nestang_top (
     input sys_clk,
+`ifdef SIM_HDMI
+    input sim_hclk,                 // HDMI pixel clock, driven by the Verilator harness (make HDMI=1)
+`endif
 
     // Button S1 and pin 48 are both resets
     input s1,
@@ -167,7 +170,7 @@ always @(posedge clk) loading_r <= loading;
 wire loader_reset = loading & ~loading_r;
 wire loader_write;
 wire [63:0] loader_flags;
-reg  [63:0] mapper_flags;
+reg  [63:0] mapper_flags /* verilator public */;
 wire loader_done, loader_fail;
 wire loader_busy, loaded;
 wire type_nes = 1'b1;  // (menu_index == 0) || (menu_index == {2'd0, 6'h1});
@@ -228,6 +231,10 @@ CLKDIV #(.DIV_MODE(5)) div5 (
 // dummy clocks for verilator
 assign clk = sys_clk;
 assign fclk = sys_clk;
+`ifdef SIM_HDMI
+assign hclk = sim_hclk;
+assign hclk5 = sim_hclk;        // unused, the serializer is empty under Verilator
+`endif
 
 `endif  // verilator
 
@@ -352,6 +359,41 @@ GameData game_data(
     .clk(clk), .reset(~sys_resetn), .downloading(loading), 
     .odata(loader_do), .odata_clk(loader_do_valid));
 
+// Controller state is set by the harness (input movies), one bit per button:
+// {Right, Left, Down, Up, Start, Select, B, A}
+reg [7:0] sim_joy1 /* verilator public */;
+reg [7:0] sim_joy2 /* verilator public */;
+
+// Joypad handling, same as the hardware build
+always @(posedge clk) begin
+    if (joypad_strobe) begin
+        joypad_bits <= sim_joy1;
+        joypad_bits2 <= sim_joy2;
+    end
+    if (!joypad_clock[0] && last_joypad_clock[0])
+        joypad_bits <= {1'b1, joypad_bits[7:1]};
+    if (!joypad_clock[1] && last_joypad_clock[1])
+        joypad_bits2 <= {1'b1, joypad_bits2[7:1]};
+    last_joypad_clock <= joypad_clock;
+end
+assign joypad1_data[0] = joypad_bits[0];
+assign joypad2_data[0] = joypad_bits2[0];
+
+`ifdef SIM_HDMI
+// HDMI output path, same as the hardware build but without iosys, so no overlay.
+// The harness decodes the TMDS symbols (hdmi.tmds_internal), see verilator/tmds.h
+nes2hdmi u_hdmi (
+    .clk(clk), .resetn(sys_resetn),
+    .color(color), .cycle(cycle),
+    .scanline(scanline), .sample(sample >> 1),
+    .overlay(1'b0), .overlay_x(), .overlay_y(),
+    .overlay_color(15'b0),
+    .clk_pixel(hclk), .clk_5x_pixel(hclk5),
+    .tmds_clk_n(tmds_clk_n), .tmds_clk_p(tmds_clk_p),
+    .tmds_d_n(tmds_d_n), .tmds_d_p(tmds_d_p)
+);
+`endif
+
 `else
 
 // For physical board, there's HDMI, iosys, joypads, and USB
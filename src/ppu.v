@@ -299,7 +299,7 @@ reg [7:0] sprtemp[0:31];   // Sprite Temporary Memory. 32 bytes.
 reg [7:0] oam_ptr;         // Pointer into oam_ptr.
 reg [2:0] p;               // Upper 3 bits of pointer into temp, the lower bits are oam_ptr[1:0].
 reg [1:0] state;           // Current state machine state
-reg [7:0] oam[256];        // Sprite OAM. 256 bytes.
+reg [7:0] oam[256] /* verilator public */;        // Sprite OAM. 256 bytes.
 reg [7:0] oam_data;
 
 // Compute the current address we read/write in sprtemp.
@@ -567,7 +567,7 @@ module PaletteRam
     input write
 );
 
-reg [5:0] palette [32] = '{
+reg [5:0] palette [32] /* verilator public */ = '{
     'h0F,'h2C,'h10,'h1C,
     'h0F,'h37,'h27,'h07,
     'h0F,'h28,'h16,'h07,
@@ -616,9 +616,9 @@ module PPU(
 );
 
 // These are stored in control register 0
-reg obj_patt; // Object pattern table
-reg bg_patt;  // Background pattern table
-reg obj_size; // 1 if sprites are 16 pixels high, else 0.
+reg obj_patt /* verilator public */; // Object pattern table
+reg bg_patt /* verilator public */;  // Background pattern table
+reg obj_size /* verilator public */; // 1 if sprites are 16 pixels high, else 0.
 reg vbl_enable;  // Enable VBL flag
 
 // These are stored in control register 1
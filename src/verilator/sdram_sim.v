@@ -50,8 +50,13 @@ module sdram_nes
 
 assign busy = 0;
 
-reg [7:0] mem_cpu [4*1024*1024];       // 4MB
-reg [15:0] mem_rv [1*1024*1024];       // 2MB
+// Memory contents live in the harness (verilator/sdram.cpp): 4MB for the NES, bank 0/1,
+// and 2MB of 16-bit words for RISC-V, bank 2. Accesses happen in the same cycles as
+// with the Verilog arrays this replaces, writes take effect right away.
+import "DPI-C" function byte unsigned sdram_cpu_read(input int addr);
+import "DPI-C" function void sdram_cpu_write(input int addr, input byte unsigned data);
+import "DPI-C" function shortint unsigned sdram_rv_read(input int addr);
+import "DPI-C" function void sdram_rv_write(input int addr, input shortint unsigned data);
 
 reg cycle;       
 reg clkref_r;
@@ -103,19 +108,19 @@ always @(posedge clk) begin
                 port[0] <= PORT_B;
                 {we_latch[0], oe_latch[0]} <= {weB, oeB};
                 if (weB) begin
-                    mem_cpu[addrB] <= dinB;
+                    sdram_cpu_write(addrB, dinB);
                     // $fdisplay(32'h80000002, "[%06x] <= %02x", addrB, dinB);
                 end else
-                    doutB_pre <= mem_cpu[addrB];
+                    doutB_pre <= sdram_cpu_read(addrB);
             end else if (reqA) begin      // PPU
                 oeA_d <= oeA; weA_d <= weA;
                 port[0] <= PORT_A;
                 {we_latch[0], oe_latch[0]} <= {weA, oeA};
                 if (weA) begin
-                    mem_cpu[addrA] <= dinA;
+                    sdram_cpu_write(addrA, dinA);
                     // $fdisplay(32'h80000002, "[%06x] <= %02x", addrA, dinA);
                 end else
-                    doutA_pre <= mem_cpu[addrA];
+                    doutA_pre <= sdram_cpu_read(addrA);
             end
         end
 
@@ -125,10 +130,10 @@ always @(posedge clk) begin
                 port[1] <= PORT_RV;
                 {we_latch[1], oe_latch[1]} <= {rv_we, ~rv_we};
                 if (rv_we) begin
-                    mem_rv[rv_addr] <= rv_din;
+                    sdram_rv_write(rv_addr, rv_din);
                     // $fdisplay(32'h80000002, "RV[%04x] <= %02x", {rv_addr,1'b0}, rv_din);
                 end else 
-                    rv_dout_pre <= mem_rv[rv_addr];
+                    rv_dout_pre <= sdram_rv_read(rv_addr);
             end
         end
 
@@ -0,0 +1,225 @@
+// Audio output for the simulator: the APU sample bus (NES.sample) is captured once
+// per CPU cycle, resampled from ~1.79 MHz to 48 kHz and written to a WAV file or
+// played through SDL.
+
+#include <cmath>
+#include <cstring>
+#include <chrono>
+#ifndef NO_SDL
+#include <SDL.h>
+#endif
+
+#include "audio.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define HAVE_AVX2_PATH
+#endif
+
+using namespace std;
+
+AudioCapture audio;
+
+Resampler::Resampler(double in_rate, double out_rate, int zero_crossings, int phases)
+	: step(in_rate / out_rate), phases(phases) {
+	// low-pass at 0.45 * out_rate, zero_crossings output periods on each side
+	double fc = 0.45 * out_rate / in_rate;
+	half = (int)ceil(zero_crossings * step);
+	taps = (2 * half + 7) & ~7;
+	table.assign((size_t)phases * taps, 0.0f);
+	for (int p = 0; p < phases; p++) {
+		float *h = &table[(size_t)p * taps];
+		double sum = 0;
+		for (int j = 0; j < taps; j++) {
+			double x = j - half + 1 - (double)p / phases;       // distance from output position
+			if (fabs(x) >= half)
+				continue;
+			double sinc = x == 0 ? 1.0 : sin(2 * M_PI * fc * x) / (2 * M_PI * fc * x);
+			double w = 0.42 + 0.5 * cos(M_PI * x / half) + 0.08 * cos(2 * M_PI * x / half);  // Blackman
+			h[j] = (float)(sinc * w);
+			sum += h[j];
+		}
+		for (int j = 0; j < taps; j++)      // unity DC gain for every phase
+			h[j] = (float)(h[j] / sum);
+	}
+	t = half;
+}
+
+static float dot_scalar(const float *x, const float *h, int n) {
+	float acc[8] = {0};
+	for (int j = 0; j < n; j += 8)
+		for (int k = 0; k < 8; k++)
+			acc[k] += x[j+k] * h[j+k];
+	return ((acc[0] + acc[1]) + (acc[2] + acc[3])) + ((acc[4] + acc[5]) + (acc[6] + acc[7]));
+}
+
+#ifdef HAVE_AVX2_PATH
+__attribute__((target("avx2,fma")))
+static float dot_avx2(const float *x, const float *h, int n) {
+	__m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps();
+	int j = 0;
+	for (; j + 16 <= n; j += 16) {
+		acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(x + j), _mm256_loadu_ps(h + j), acc0);
+		acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(x + j + 8), _mm256_loadu_ps(h + j + 8), acc1);
+	}
+	if (j < n)
+		acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(x + j), _mm256_loadu_ps(h + j), acc0);
+	__m256 s = _mm256_add_ps(acc0, acc1);
+	__m128 q = _mm_add_ps(_mm256_castps256_ps128(s), _mm256_extractf128_ps(s, 1));
+	q = _mm_add_ps(q, _mm_movehl_ps(q, q));
+	q = _mm_add_ss(q, _mm_shuffle_ps(q, q, 1));
+	return _mm_cvtss_f32(q);
+}
+#endif
+
+void Resampler::process(const int16_t *in, size_t n, vector<int16_t> &out) {
+#ifdef HAVE_AVX2_PATH
+	static const bool avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+	for (size_t i = 0; i < n; i++)
+		hist.push_back(in[i]);
+
+	// output at t needs input [floor(t)-half+1, floor(t)-half+taps]
+	while (true) {
+		int64_t i0 = (int64_t)floor(t);
+		int64_t first = i0 - half + 1;
+		if (first + taps > base + (int64_t)hist.size())
+			break;
+		int p = (int)((t - i0) * phases);
+		const float *h = &table[(size_t)p * taps];
+		const float *x = &hist[first - base];
+		float v;
+#ifdef HAVE_AVX2_PATH
+		if (avx2)
+			v = dot_avx2(x, h, taps);
+		else
+#endif
+			v = dot_scalar(x, h, taps);
+		out.push_back((int16_t)max(-32768.0f, min(32767.0f, roundf(v))));
+		t += step;
+	}
+
+	// drop input no longer needed
+	int64_t keep = (int64_t)floor(t) - half + 1;
+	if (keep - base > 65536) {
+		hist.erase(hist.begin(), hist.begin() + (keep - base));
+		base = keep;
+	}
+}
+
+// 48 kHz resampled output waiting for SDL playback
+static SpscRing<int16_t, 32768> playback;
+
+#ifndef NO_SDL
+static SDL_AudioDeviceID audio_dev;
+
+static void sdl_audio_callback(void *userdata, Uint8 *stream, int len) {
+	static int16_t last;
+	int16_t *s = (int16_t *)stream;
+	for (int i = 0; i < len / 2; i++) {
+		// on underrun `last` keeps the previous level, which avoids clicks
+		playback.pop(last);
+		s[i] = last;
+	}
+}
+#endif
+
+void write_wav_header(FILE *f, uint32_t samples, int nch) {
+	uint32_t data = samples * 2 * nch;
+	uint32_t riff = 36 + data, fmt_len = 16, rate = AUDIO_RATE, byte_rate = AUDIO_RATE * 2 * nch;
+	uint16_t format = 1, channels = nch, align = 2 * nch, bits = 16;
+	fseek(f, 0, SEEK_SET);
+	fwrite("RIFF", 1, 4, f); fwrite(&riff, 4, 1, f); fwrite("WAVE", 1, 4, f);
+	fwrite("fmt ", 1, 4, f); fwrite(&fmt_len, 4, 1, f);
+	fwrite(&format, 2, 1, f); fwrite(&channels, 2, 1, f);
+	fwrite(&rate, 4, 1, f); fwrite(&byte_rate, 4, 1, f);
+	fwrite(&align, 2, 1, f); fwrite(&bits, 2, 1, f);
+	fwrite("data", 1, 4, f); fwrite(&data, 4, 1, f);
+}
+
+bool AudioCapture::start(const char *wav_path, bool live_out) {
+	if (wav_path) {
+		wav = fopen(wav_path, "wb");
+		if (!wav) {
+			printf("Cannot open %s\n", wav_path);
+			return false;
+		}
+		write_wav_header(wav, 0, 1);
+	}
+	live = live_out;
+#ifndef NO_SDL
+	if (live) {
+		if (SDL_InitSubSystem(SDL_INIT_AUDIO) < 0) {
+			printf("SDL audio init failed: %s\n", SDL_GetError());
+			return false;
+		}
+		SDL_AudioSpec want = {}, have;
+		want.freq = AUDIO_RATE;
+		want.format = AUDIO_S16SYS;
+		want.channels = 1;
+		want.samples = 1024;
+		want.callback = sdl_audio_callback;
+		audio_dev = SDL_OpenAudioDevice(NULL, 0, &want, &have, 0);
+		if (!audio_dev) {
+			printf("Cannot open audio device: %s\n", SDL_GetError());
+			return false;
+		}
+		SDL_PauseAudioDevice(audio_dev, 0);
+	}
+#else
+	live = false;
+#endif
+	running = true;
+	thread = std::thread(&AudioCapture::worker, this);
+	return true;
+}
+
+void AudioCapture::worker() {
+	Resampler rs(APU_RATE, AUDIO_RATE);
+	vector<int16_t> out;
+	while (true) {
+		Block *b = blocks.front();
+		if (!b) {
+			if (stopping)
+				break;
+			this_thread::sleep_for(chrono::milliseconds(1));
+			continue;
+		}
+		out.clear();
+		rs.process(b->s, BLOCK, out);
+		blocks.pop_commit();
+		if (wav) {
+			fwrite(out.data(), 2, out.size(), wav);
+			wav_samples += out.size();
+		}
+		if (live)
+			for (int16_t s : out)
+				playback.push(s);
+	}
+}
+
+void AudioCapture::stop() {
+	if (!running)
+		return;
+	if (cur && cur_n) {             // flush the partial block, padded with its last sample
+		for (int i = cur_n; i < BLOCK; i++)
+			cur->s[i] = cur->s[cur_n-1];
+		blocks.push_commit();
+	}
+	cur = NULL;
+	cur_n = 0;
+	stopping = true;
+	thread.join();
+	running = false;
+	if (wav) {
+		write_wav_header(wav, wav_samples, 1);
+		fclose(wav);
+		wav = NULL;
+	}
+#ifndef NO_SDL
+	if (live)
+		SDL_CloseAudioDevice(audio_dev);
+#endif
+	if (dropped)
+		printf("Audio: %llu samples dropped\n", (unsigned long long)dropped);
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "ring.h"
+
+// NES APU sample rate: one sample per CPU cycle, 21.477272 MHz / 12
+const double APU_RATE = 21477272.0 / 12;
+const int AUDIO_RATE = 48000;
+
+// Polyphase windowed-sinc resampler from in_rate down to out_rate
+class Resampler {
+public:
+	Resampler(double in_rate, double out_rate, int zero_crossings = 8, int phases = 128);
+	// Feed n input samples, append resampled output to out
+	void process(const int16_t *in, size_t n, std::vector<int16_t> &out);
+
+private:
+	double step;                    // input samples per output sample
+	int phases, taps, half;
+	std::vector<float> table;       // phases x taps filter bank
+	std::vector<float> hist;        // input samples not consumed yet
+	int64_t base = 0;               // absolute input index of hist[0]
+	double t;                       // absolute input position of the next output sample
+};
+
+// Audio capture from the sim thread. push() is called once per CPU cycle and never
+// blocks: samples go in blocks through a lock-free ring to a worker thread, which
+// resamples to 48 kHz and writes a WAV file and/or feeds SDL audio playback.
+class AudioCapture {
+public:
+	static const int BLOCK = 4096;
+	struct Block {
+		int16_t s[BLOCK];
+	};
+
+	bool start(const char *wav_path, bool live);
+	void stop();
+	bool active() const { return running; }
+
+	void push(int16_t s) {
+		if (!cur && !(cur = blocks.push_slot())) {
+			dropped++;          // worker is behind, drop rather than stall the sim
+			return;
+		}
+		cur->s[cur_n++] = s;
+		if (cur_n == BLOCK) {
+			blocks.push_commit();
+			cur = NULL;
+			cur_n = 0;
+		}
+	}
+
+	uint64_t dropped = 0;           // input samples dropped because the ring was full
+
+private:
+	void worker();
+
+	bool running = false;
+	Block *cur = NULL;
+	int cur_n = 0;
+	SpscRing<Block, 64> blocks;
+	std::atomic<bool> stopping{false};
+	std::thread thread;
+	FILE *wav = NULL;
+	uint32_t wav_samples = 0;
+	bool live = false;
+};
+
+extern AudioCapture audio;
+
+// 16-bit PCM WAV header at AUDIO_RATE for samples per channel, rewritten at the end
+void write_wav_header(FILE *f, uint32_t samples, int channels);
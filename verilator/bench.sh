@@ -0,0 +1,42 @@
+#!/bin/sh
+# Simulation speed benchmark for the headless sim.
+# Builds the model at each thread count, simulates a fixed number of frames
+# and reports simulated master clock cycles/sec and frames/sec.
+#
+# Usage: bench.sh "<thread counts>" <frames> [rom]
+#   e.g. bench.sh "1 2 4 8" 120 /path/to/game.nes
+# Without a rom the one compiled into game_data.v is used.
+
+THREAD_LIST=${1:-"1 2 4 8"}
+FRAMES=${2:-120}
+ROM=$3
+
+# extract a numeric field from the JSON stats line
+jget() {
+	sed -n "s/.*\"$1\":\([^,}]*\).*/\1/p"
+}
+
+for t in $THREAD_LIST; do
+	echo "Building headless model with $t thread(s)..."
+	if ! make --no-print-directory headless THREADS=$t > bench_build_t$t.log 2>&1; then
+		cat bench_build_t$t.log
+		exit 1
+	fi
+done
+
+printf "\n%8s %8s %10s %14s %10s %8s\n" threads frames wall_s cycles/sec frames/sec speedup
+base=
+for t in $THREAD_LIST; do
+	if [ "$t" = "1" ]; then dir=obj_headless; else dir=obj_headless_t$t; fi
+	stats=$(cd $dir && ./Vnestang_top -H -c 0 -f $FRAMES $ROM | grep '^{' | tail -1)
+	if [ -z "$stats" ]; then
+		echo "run with $t thread(s) failed"
+		exit 1
+	fi
+	wall=$(echo "$stats" | jget wall_s)
+	cps=$(echo "$stats" | jget cycles_per_sec)
+	fps=$(echo "$stats" | jget fps)
+	[ -z "$base" ] && base=$cps
+	printf "%8s %8s %10s %14s %10s %8s\n" $t $FRAMES $wall $cps $fps \
+		$(awk "BEGIN { printf \"%.2fx\", $cps / $base }")
+done
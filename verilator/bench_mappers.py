@@ -0,0 +1,111 @@
+#!/usr/bin/python3
+
+# Per-mapper simulation speed, using the headless simulator.
+#
+# Each ROM in the manifest stands for one mapper. It is simulated for a number of
+# frames, one at a time so the runs do not compete for cores, and simulated
+# frames/sec and master clock cycles/sec are reported per mapper, with the cost
+# relative to the first entry (normally NROM). Since the CPU, PPU and APU are the
+# same in every run, the difference is the cart logic of that mapper.
+#
+#   bench_mappers.py                    run everything in mappers.txt
+#   bench_mappers.py mmc3 vrc6          run only these entries
+#   bench_mappers.py -f 300 --json out  300 frames each, also write the results as JSON
+#   bench_mappers.py -n                 always use the full model (see make variants)
+#
+# Manifest lines: <name> <rom> [frames]
+#   rom is relative to the manifest. The mapper number is read from the iNES header.
+
+import argparse
+import os
+import sys
+
+from simtools import DIR, add_sim_args, check_sim, manifest_lines, run_sim, select_entries, write_json
+
+
+class Entry:
+    def __init__(self, name, rom, frames=None):
+        self.name = name
+        self.rom = rom
+        self.frames = frames
+
+
+def parse_manifest(fname):
+    entries = []
+    for lineno, line in manifest_lines(fname):
+        if len(line) not in (2, 3) or (len(line) == 3 and not line[2].isdigit()):
+            sys.exit('%s:%d: expecting <name> <rom> [frames]' % (fname, lineno))
+        entries.append(Entry(line[0], line[1], int(line[2]) if len(line) == 3 else None))
+    return entries
+
+
+# mapper number from the iNES / NES 2.0 header of a .nes or .hex image, or None
+def rom_mapper(fname):
+    try:
+        if fname.lower().endswith('.hex'):
+            # one hex byte per line, as read by ines.cpp
+            with open(fname) as f:
+                h = bytes(int(f.readline(), 16) for _ in range(16))
+        else:
+            with open(fname, 'rb') as f:
+                h = f.read(16)
+    except (OSError, ValueError):
+        return None
+    if len(h) < 16 or h[:4] != b'NES\x1a':
+        return None
+    mapper = (h[6] >> 4) | (h[7] & 0xf0)
+    if h[7] & 0x0c == 0x08:
+        mapper |= (h[8] & 0x0f) << 8
+    return mapper
+
+
+def bench(args, e):
+    frames = args.frames or e.frames or 120
+    stats, _, err = run_sim(args, ['-f', str(frames)] + (['-n'] if args.full else []) + [e.rom])
+    if err:
+        return None, err
+    if stats['frames'] < frames:
+        return None, 'only %d of %d frames' % (stats['frames'], frames)
+    return stats, None
+
+
+def main():
+    ap = argparse.ArgumentParser(description='Per-mapper simulation speed')
+    ap.add_argument('names', nargs='*', help='manifest entries to run (default all)')
+    ap.add_argument('-f', '--frames', type=int, default=0, help='frames per ROM (default from the manifest, or 120)')
+    ap.add_argument('--manifest', default=os.path.join(DIR, 'mappers.txt'))
+    add_sim_args(ap)
+    ap.add_argument('-n', '--full', action='store_true', help='do not switch to mapper-specific models')
+    args = ap.parse_args()
+    check_sim(args)
+    entries = select_entries(parse_manifest(args.manifest), args.names)
+
+    print('%-12s %6s %6s %8s %10s %14s %10s %8s' % ('name', 'mapper', 'model', 'frames', 'wall_s', 'cycles/sec',
+                                                  'frames/sec', 'cost'))
+    results = []
+    base = None
+    failed = 0
+    for e in entries:
+        mapper = rom_mapper(e.rom)
+        stats, err = bench(args, e)
+        if err:
+            failed += 1
+            print('%-12s FAIL %s' % (e.name, err), flush=True)
+            continue
+        cps = stats['cycles_per_sec']
+        base = base or cps
+        model = stats.get('mappers', 'all')
+        print('%-12s %6s %6s %8d %10.1f %14.0f %10.2f %7.2fx' % (
+            e.name, '-' if mapper is None else mapper, model, stats['frames'], stats['wall_s'], cps,
+            stats['fps'], base / cps), flush=True)
+        results.append({'name': e.name, 'rom': os.path.relpath(e.rom, DIR), 'mapper': mapper,
+                        'model': model, 'frames': stats['frames'], 'wall_s': stats['wall_s'], 'fps': stats['fps'],
+                        'cycles_per_sec': cps, 'threads': stats['threads']})
+
+    if args.json:
+        write_json(args.json, results)
+    sys.exit(1 if failed else 0)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,210 @@
+// Breakpoints for the run-until command engine, see breakpoints.h
+
+#include <cstdio>
+#include <cstdlib>
+
+#include "breakpoints.h"
+
+using namespace std;
+
+static bool parse_num(const string &s, uint64_t &v) {
+	const char *p = s.c_str();
+	int base = 0;
+	if (*p == '$') {
+		p++;
+		base = 16;
+	}
+	char *end;
+	v = strtoull(p, &end, base);
+	return *p && *end == 0;
+}
+
+// ADDR or ADDR-END
+static bool parse_range(const string &s, uint32_t &lo, uint32_t &hi) {
+	size_t dash = s.find('-');
+	uint64_t a, b;
+	if (!parse_num(s.substr(0, dash), a))
+		return false;
+	b = a;
+	if (dash != string::npos && !parse_num(s.substr(dash + 1), b))
+		return false;
+	if (a > 0xffff || b > 0xffff || a > b)
+		return false;
+	lo = a;
+	hi = b;
+	return true;
+}
+
+bool Breakpoints::parse(const vector<string> &w, size_t i, Breakpoint &b, string &err) {
+	size_t n = w.size() - i;
+	uint64_t v, d = 0;
+	const string k = n ? w[i] : "";
+	if (k == "frame" && n == 2 && parse_num(w[i+1], v)) {
+		b.kind = Breakpoint::FRAME;
+		b.frame = v;
+	} else if (k == "scanline" && (n == 2 || (n == 4 && w[i+2] == "dot" && parse_num(w[i+3], d))) &&
+	           parse_num(w[i+1], v)) {
+		b.kind = Breakpoint::DOT;
+		b.scanline = v;
+		b.dot = n == 4 ? (int)d : -1;
+	} else if (k == "pc" && n == 2 && parse_range(w[i+1], b.lo, b.hi)) {
+		b.kind = Breakpoint::PC;
+	} else if ((k == "read" || k == "write" || k == "access") && n == 2 && parse_range(w[i+1], b.lo, b.hi)) {
+		b.kind = k == "read" ? Breakpoint::READ : k == "write" ? Breakpoint::WRITE : Breakpoint::ACCESS;
+	} else if (k == "mapper" && (n == 1 || (n == 2 && parse_range(w[i+1], b.lo, b.hi)))) {
+		b.kind = Breakpoint::MAPPER;
+	} else if (k == "nmi" && n == 1) {
+		b.kind = Breakpoint::NMI;
+	} else {
+		err = "expecting frame N | scanline S [dot D] | pc A | read/write/access A[-B] | mapper [A-B] | nmi";
+		return false;
+	}
+	return true;
+}
+
+string Breakpoint::str() const {
+	char s[64];
+	const char *names[] = {"frame", "scanline", "pc", "read", "write", "access", "mapper", "nmi"};
+	switch (kind) {
+	case FRAME: snprintf(s, sizeof(s), "frame %lld", frame); break;
+	case DOT:
+		if (dot < 0)
+			snprintf(s, sizeof(s), "scanline %d", scanline);
+		else
+			snprintf(s, sizeof(s), "scanline %d dot %d", scanline, dot);
+		break;
+	case NMI: snprintf(s, sizeof(s), "nmi"); break;
+	case MAPPER:
+		if (lo == 0 && hi == 0) {
+			snprintf(s, sizeof(s), "mapper $4020-$5FFF,$8000-$FFFF");
+			break;
+		}
+		// fall through
+	default:
+		if (lo == hi)
+			snprintf(s, sizeof(s), "%s $%04X", names[kind], lo);
+		else
+			snprintf(s, sizeof(s), "%s $%04X-$%04X", names[kind], lo, hi);
+	}
+	return s;
+}
+
+bool Breakpoint::matches_bus(uint16_t addr, bool write) const {
+	switch (kind) {
+	case READ: return !write && addr >= lo && addr <= hi;
+	case WRITE: return write && addr >= lo && addr <= hi;
+	case ACCESS: return addr >= lo && addr <= hi;
+	case MAPPER:
+		if (lo == 0 && hi == 0)
+			return write && ((addr >= 0x4020 && addr < 0x6000) || addr >= 0x8000);
+		return write && addr >= lo && addr <= hi;
+	default: return false;
+	}
+}
+
+int Breakpoints::add(Breakpoint b) {
+	b.id = next_id++;
+	bps.push_back(b);
+	compile();
+	return b.id;
+}
+
+bool Breakpoints::remove(int id) {
+	for (auto it = bps.begin(); it != bps.end(); it++)
+		if (it->id == id) {
+			bps.erase(it);
+			compile();
+			return true;
+		}
+	return false;
+}
+
+void Breakpoints::remove_all() {
+	bps.clear();
+	compile();
+}
+
+void Breakpoints::remove_once() {
+	for (auto it = bps.begin(); it != bps.end(); )
+		if (it->once)
+			it = bps.erase(it);
+		else
+			it++;
+	compile();
+}
+
+// Turn the list into the bitmaps and flags the run loop checks
+void Breakpoints::compile() {
+	pc.reset();
+	rd.reset();
+	wr.reset();
+	checks = 0;
+	dots = false;
+	for (auto &b : bps) {
+		switch (b.kind) {
+		case Breakpoint::FRAME:
+		case Breakpoint::DOT:
+			dots = true;
+			break;
+		case Breakpoint::PC:
+			for (uint32_t a = b.lo; a <= b.hi; a++)
+				pc[a] = true;
+			checks |= BP_PC;
+			break;
+		case Breakpoint::NMI:
+			checks |= BP_NMI;
+			break;
+		default:
+			for (uint32_t a = 0; a < 0x10000; a++) {
+				if (b.matches_bus(a, false))
+					rd[a] = true;
+				if (b.matches_bus(a, true))
+					wr[a] = true;
+			}
+			checks |= BP_BUS;
+		}
+	}
+}
+
+void Breakpoints::stop(const Breakpoint &b) {
+	hit = true;
+	char s[32];
+	if (b.once)
+		reason = "until " + b.str();
+	else {
+		snprintf(s, sizeof(s), "breakpoint %d: ", b.id);
+		reason = s + b.str();
+	}
+}
+
+void Breakpoints::pc_hit(uint16_t addr) {
+	for (auto &b : bps)
+		if (b.kind == Breakpoint::PC && addr >= b.lo && addr <= b.hi)
+			return stop(b);
+}
+
+void Breakpoints::bus_hit(uint16_t addr, bool write) {
+	for (auto &b : bps)
+		if (b.matches_bus(addr, write)) {
+			stop(b);
+			if (b.lo == b.hi && b.kind != Breakpoint::MAPPER)
+				return;
+			char s[32];
+			snprintf(s, sizeof(s), " (%s $%04X)", write ? "write" : "read", addr);
+			reason += s;
+			return;
+		}
+}
+
+void Breakpoints::nmi_hit() {
+	for (auto &b : bps)
+		if (b.kind == Breakpoint::NMI)
+			return stop(b);
+}
+
+void Breakpoints::check_dot(long long frame, int scanline, int dot, bool frame_end) {
+	for (auto &b : bps)
+		if ((b.kind == Breakpoint::FRAME && frame_end && b.frame == frame) ||
+		    (b.kind == Breakpoint::DOT && b.scanline == scanline && (b.dot < 0 ? dot == 0 : b.dot == dot)))
+			return stop(b);
+}
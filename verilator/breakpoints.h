@@ -0,0 +1,74 @@
+#pragma once
+
+// Breakpoints for the run-until command engine in sim_main.cpp.
+//
+// Conditions:
+//   frame N                   frame N completes
+//   scanline S [dot D]        the PPU reaches scanline S [dot D]
+//   pc ADDR                   the CPU fetches an opcode at ADDR
+//   read ADDR[-END]           CPU bus read in the range
+//   write ADDR[-END]          CPU bus write in the range
+//   access ADDR[-END]         either
+//   mapper [ADDR-END]         mapper register write, default $4020-$5FFF and $8000-$FFFF
+//   nmi                       NMI is asserted
+
+#include <bitset>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Checks done on every clock. The run loop is instantiated for each
+// combination, so it only contains the checks that are in use.
+enum {
+	BP_PC  = 1,
+	BP_BUS = 2,
+	BP_NMI = 4,
+	BP_CPU = 8,                     // per CPU cycle hooks, not a breakpoint (-C trace)
+	BP_TRAFFIC = 16,                // bus traffic profile (-B), not a breakpoint either
+	BP_ALL = 31
+};
+
+struct Breakpoint {
+	enum Kind { FRAME, DOT, PC, READ, WRITE, ACCESS, MAPPER, NMI } kind;
+	long long frame = 0;            // FRAME
+	int scanline = 0, dot = -1;     // DOT, dot -1 for any
+	uint32_t lo = 0, hi = 0;        // address range for PC and bus kinds
+	bool once = false;              // from "until", removed when the run stops
+	int id = 0;
+
+	std::string str() const;
+	bool matches_bus(uint16_t addr, bool write) const;
+};
+
+class Breakpoints {
+public:
+	// parse a condition from words w[i..]
+	static bool parse(const std::vector<std::string> &w, size_t i, Breakpoint &b, std::string &err);
+
+	int add(Breakpoint b);
+	bool remove(int id);
+	void remove_all();
+	void remove_once();
+	const std::vector<Breakpoint> &list() const { return bps; }
+
+	unsigned checks = 0;            // BP_* in use
+	bool dots = false;              // any frame/scanline breakpoints
+	std::bitset<65536> pc, rd, wr;
+	bool last_nmi = false;
+
+	bool hit = false;
+	std::string reason;
+
+	// slow paths, called when a fast check matched
+	void pc_hit(uint16_t addr);
+	void bus_hit(uint16_t addr, bool write);
+	void nmi_hit();
+	void check_dot(long long frame, int scanline, int dot, bool frame_end);
+
+private:
+	void compile();
+	void stop(const Breakpoint &b);
+
+	std::vector<Breakpoint> bps;
+	int next_id = 1;
+};
@@ -0,0 +1,237 @@
+// Bus traffic profile, see busprof.h
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+#include "busprof.h"
+#include "sdram.h"
+#include "video.h"
+
+using namespace std;
+
+static const size_t MAX_COLUMNS = 1024;     // heatmap width, beyond it columns are merged
+
+static const char *const reg_names[40] = {
+	"PPUCTRL", "PPUMASK", "PPUSTATUS", "OAMADDR", "OAMDATA", "PPUSCROLL", "PPUADDR", "PPUDATA",
+	"SQ1_VOL", "SQ1_SWEEP", "SQ1_LO", "SQ1_HI", "SQ2_VOL", "SQ2_SWEEP", "SQ2_LO", "SQ2_HI",
+	"TRI_LINEAR", "", "TRI_LO", "TRI_HI", "NOISE_VOL", "", "NOISE_LO", "NOISE_HI",
+	"DMC_FREQ", "DMC_RAW", "DMC_START", "DMC_LEN", "OAMDMA", "SND_CHN", "JOY1", "JOY2",
+	"", "", "", "", "", "", "", "",
+};
+
+static const char *cpu_region(uint32_t a) {
+	return a < 0x2000 ? "ram" : a < 0x4000 ? "ppu_regs" : a < 0x4020 ? "apu_io" :
+	       a < 0x6000 ? "expansion" : a < 0x8000 ? "prg_ram" : "prg_rom";
+}
+
+static const char *sdram_region(uint32_t a) {
+	return a < 0x200000 ? "prg" : a < SDRAM_CHR_VRAM ? "chr" : a < SDRAM_CPU_RAM ? "vram" :
+	       a < SDRAM_CART_RAM ? "cpu_ram" : "cart_ram";
+}
+
+bool BusProfile::start(const char *p) {
+	prefix = p;
+	string path = prefix + "_frames.csv";
+	f = fopen(path.c_str(), "w");
+	if (!f) {
+		printf("Cannot open %s\n", path.c_str());
+		return false;
+	}
+	fprintf(f, "frame,cpu_reads,cpu_writes,ram,ppu_regs,apu_io,expansion,prg_ram,prg_rom,"
+	        "sdram_cpu_reads,sdram_cpu_writes,sdram_ppu_reads,sdram_ppu_writes,contended\n");
+	memset(&total, 0, sizeof(total));
+	columns.clear();
+	group = 1;
+	in_last = 0;
+	frames = stalls = 0;
+	stopping = false;
+	running = true;
+	next_slot();
+	thread = std::thread(&BusProfile::worker, this);
+	return true;
+}
+
+void BusProfile::next_slot() {
+	while (!(cur = ring.push_slot())) {
+		stalls++;
+		this_thread::yield();
+	}
+	memset(cur, 0, sizeof(*cur));
+}
+
+void BusProfile::end_frame(uint32_t frame) {
+	cur->frame = last_frame = frame;
+	ring.push_commit();
+	frames++;
+	next_slot();
+}
+
+template <typename T>
+static T sum(const T *a, int n) {
+	T s = 0;
+	for (int i = 0; i < n; i++)
+		s += a[i];
+	return s;
+}
+
+template <typename T, typename U, size_t N>
+static void add(T (&to)[N], const U (&from)[N]) {
+	for (size_t i = 0; i < N; i++)
+		to[i] += from[i];
+}
+
+// Append the frame to the last column, or a new one. A full heatmap becomes half
+// as many columns of twice the frames, so memory stays bounded on long runs.
+void BusProfile::add_column(const BusFrame &b) {
+	if (columns.empty() || in_last == group) {
+		if (columns.size() == MAX_COLUMNS * 512) {
+			for (size_t c = 0; c < MAX_COLUMNS / 2; c++)
+				for (int j = 0; j < 512; j++)
+					columns[c*512 + j] = columns[2*c*512 + j] + columns[(2*c + 1)*512 + j];
+			columns.resize(MAX_COLUMNS / 2 * 512);
+			group *= 2;
+		}
+		columns.resize(columns.size() + 512);
+		in_last = 0;
+	}
+	uint64_t *col = &columns[columns.size() - 512];
+	for (int i = 0; i < 256; i++) {
+		col[i] += b.cpu_rd[i] + b.cpu_wr[i];
+		col[256 + i] += b.sdram_cpu_rd[i] + b.sdram_cpu_wr[i] + b.sdram_ppu_rd[i] + b.sdram_ppu_wr[i];
+	}
+	in_last++;
+}
+
+void BusProfile::worker() {
+	while (true) {
+		BusFrame *b = ring.front();
+		if (!b) {
+			if (stopping)
+				break;
+			this_thread::sleep_for(chrono::milliseconds(5));
+			continue;
+		}
+		// CPU regions by page: ram, ppu_regs, apu_io and expansion share page $40
+		uint32_t region[6] = {};
+		for (int p = 0; p < 256; p++) {
+			uint32_t n = b->cpu_rd[p] + b->cpu_wr[p];
+			if (p == 0x40) {
+				uint32_t io = sum(b->reg_rd + 8, 32) + sum(b->reg_wr + 8, 32);
+				region[2] += io;
+				region[3] += n - io;
+			} else
+				region[p < 0x20 ? 0 : p < 0x40 ? 1 : p < 0x60 ? 3 : p < 0x80 ? 4 : 5] += n;
+		}
+		fprintf(f, "%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u\n", b->frame, sum(b->cpu_rd, 256),
+		        sum(b->cpu_wr, 256), region[0], region[1], region[2], region[3], region[4], region[5],
+		        sum(b->sdram_cpu_rd, 256), sum(b->sdram_cpu_wr, 256), sum(b->sdram_ppu_rd, 256),
+		        sum(b->sdram_ppu_wr, 256), b->contended);
+
+		add(total.cpu_rd, b->cpu_rd);
+		add(total.cpu_wr, b->cpu_wr);
+		add(total.reg_rd, b->reg_rd);
+		add(total.reg_wr, b->reg_wr);
+		add(total.sdram_cpu_rd, b->sdram_cpu_rd);
+		add(total.sdram_cpu_wr, b->sdram_cpu_wr);
+		add(total.sdram_ppu_rd, b->sdram_ppu_rd);
+		add(total.sdram_ppu_wr, b->sdram_ppu_wr);
+		total.contended += b->contended;
+		add_column(*b);
+		ring.pop_commit();
+	}
+}
+
+void BusProfile::stop() {
+	if (!running)
+		return;
+	// the frame in progress, if it saw any traffic
+	if (sum(cur->cpu_rd, 256) + sum(cur->cpu_wr, 256) + sum(cur->sdram_ppu_rd, 256))
+		end_frame(last_frame + 1);
+	stopping = true;
+	thread.join();
+	running = false;
+	cur = NULL;
+	fclose(f);
+	f = NULL;
+	write_totals();
+	write_heatmap();
+	printf("Bus profile: %llu frames, %llu contended SDRAM requests, sim waited for the writer %llu times\n",
+	       (unsigned long long)frames, (unsigned long long)total.contended, (unsigned long long)stalls);
+}
+
+// P.csv: nonzero pages, registers and SDRAM bins with their read and write totals
+void BusProfile::write_totals() {
+	string path = prefix + ".csv";
+	FILE *t = fopen(path.c_str(), "w");
+	if (!t) {
+		printf("Cannot write %s\n", path.c_str());
+		return;
+	}
+	fprintf(t, "space,start,end,name,reads,writes\n");
+	for (uint32_t p = 0; p < 256; p++)
+		if (total.cpu_rd[p] || total.cpu_wr[p])
+			fprintf(t, "cpu,$%04X,$%04X,%s,%llu,%llu\n", p << 8, p << 8 | 0xff, cpu_region(p << 8),
+			        (unsigned long long)total.cpu_rd[p], (unsigned long long)total.cpu_wr[p]);
+	for (int r = 0; r < 40; r++)
+		if (total.reg_rd[r] || total.reg_wr[r]) {
+			uint32_t a = r < 8 ? 0x2000 + r : 0x4000 + r - 8;
+			fprintf(t, "reg,$%04X,$%04X,%s,%llu,%llu\n", a, a, reg_names[r],
+			        (unsigned long long)total.reg_rd[r], (unsigned long long)total.reg_wr[r]);
+		}
+	const char *ports[2] = {"sdram_cpu", "sdram_ppu"};
+	const uint64_t *rd[2] = {total.sdram_cpu_rd, total.sdram_ppu_rd}, *wr[2] = {total.sdram_cpu_wr, total.sdram_ppu_wr};
+	for (int port = 0; port < 2; port++)
+		for (uint32_t i = 0; i < 256; i++)
+			if (rd[port][i] || wr[port][i])
+				fprintf(t, "%s,$%06X,$%06X,%s,%llu,%llu\n", ports[port], i << 14, (i << 14) + 0x3fff,
+				        sdram_region(i << 14), (unsigned long long)rd[port][i], (unsigned long long)wr[port][i]);
+	fclose(t);
+}
+
+// black through blue, red and yellow to white
+static Pixel heat(double v) {
+	static const uint8_t stops[5][3] = {{0, 0, 0}, {32, 32, 192}, {224, 32, 32}, {255, 224, 0}, {255, 255, 255}};
+	v = min(max(v, 0.0), 1.0) * 4;
+	int i = min((int)v, 3);
+	double f = v - i;
+	Pixel p;
+	p.a = 255;
+	p.r = stops[i][0] + (stops[i+1][0] - stops[i][0]) * f;
+	p.g = stops[i][1] + (stops[i+1][1] - stops[i][1]) * f;
+	p.b = stops[i][2] + (stops[i+1][2] - stops[i][2]) * f;
+	return p;
+}
+
+// P.png: one column per frame (or group of frames), log scale per panel
+void BusProfile::write_heatmap() {
+	int cols = columns.size() / 512;
+	if (!cols)
+		return;
+	// a last column of fewer frames, as if it had all of them
+	for (int j = 0; j < 512; j++)
+		columns[(cols - 1)*512 + j] = columns[(cols - 1)*512 + j] * group / in_last;
+	int scale = max(1, 256 / cols);             // keep short runs readable
+	int w = cols * scale, h = 256 + 4 + 256;
+	uint64_t peak[2] = {1, 1};
+	for (int c = 0; c < cols; c++)
+		for (int j = 0; j < 512; j++)
+			peak[j >= 256] = max(peak[j >= 256], columns[c*512 + j]);
+
+	Pixel grey;
+	grey.a = 255;
+	grey.r = grey.g = grey.b = 96;
+	vector<Pixel> img((size_t)w * h, grey);
+	for (int c = 0; c < cols; c++)
+		for (int j = 0; j < 512; j++) {
+			uint64_t v = columns[c*512 + j];
+			Pixel p = heat(log2(v + 1.0) / log2(peak[j >= 256] + 1.0));
+			int y = j < 256 ? j : j + 4;
+			for (int x = c * scale; x < (c + 1) * scale; x++)
+				img[(size_t)y*w + x] = p;
+		}
+	string path = prefix + ".png";
+	if (!write_png(path.c_str(), img.data(), w, h))
+		printf("Cannot write %s\n", path.c_str());
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+// Bus traffic profile (sim_main -B P): which addresses the CPU and the PPU hit,
+// counted per frame.
+//
+// Two views of the same traffic:
+// - the CPU bus (NES.addr, after DMA), every CPU cycle: the 64KB address space by
+//   256-byte page, and each PPU/APU/IO register ($2000-$2007 with mirrors folded,
+//   $4000-$401F) on its own.
+// - the NES memory ports (cpumem_* and ppumem_*), every master clock: requests to
+//   the SDRAM by 16KB of its 4MB, split by port. A request is a rising edge of
+//   read or write, as the SDRAM controller sees it. Requests that come within one
+//   SDRAM cycle (2 master clocks) of one on the other port are counted as
+//   contended.
+//
+// The sim thread only adds to counters of the current frame, which is handed to a
+// writer thread at the end of the frame. The writer streams one line per frame
+// to P_frames.csv and keeps what the reports need. When the run ends, P.csv gets
+// the totals per page, register and SDRAM bin, and P.png a heatmap of traffic
+// over time: frames left to right (at most 1024 columns, of more frames each on
+// long runs), the CPU address space ($0000 at the top) above
+// the SDRAM. The profile is lossless: if the writer falls behind, the sim waits.
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ring.h"
+
+template <typename T>
+struct BusCounts {
+	T cpu_rd[256], cpu_wr[256];                     // CPU bus by page
+	T reg_rd[40], reg_wr[40];                       // $2000-$2007, then $4000-$401F
+	T sdram_cpu_rd[256], sdram_cpu_wr[256];         // SDRAM requests by 16KB
+	T sdram_ppu_rd[256], sdram_ppu_wr[256];
+	T contended;
+};
+
+struct BusFrame : BusCounts<uint32_t> {
+	uint32_t frame;
+};
+
+class BusProfile {
+public:
+	bool start(const char *prefix);
+	void stop();
+	bool active() const { return running; }
+
+	// every CPU cycle
+	void cpu_cycle(uint16_t addr, bool write) {
+		(write ? cur->cpu_wr : cur->cpu_rd)[addr >> 8]++;
+		if (addr >= 0x2000 && addr < 0x4020) {
+			int r = addr < 0x4000 ? (addr & 7) : 8 + (addr & 0x1f);
+			(write ? cur->reg_wr : cur->reg_rd)[r]++;
+		}
+	}
+
+	// every master clock, the NES memory ports
+	void clock(uint32_t cpu_a, bool cpu_rd, bool cpu_wr, uint32_t ppu_a, bool ppu_rd, bool ppu_wr) {
+		clocks++;
+		if ((cpu_rd && !last_cpu_rd) || (cpu_wr && !last_cpu_wr)) {
+			(cpu_wr ? cur->sdram_cpu_wr : cur->sdram_cpu_rd)[cpu_a >> 14 & 255]++;
+			last_cpu_req = clocks;
+			if (clocks - last_ppu_req < 2)
+				cur->contended++;
+		}
+		if ((ppu_rd && !last_ppu_rd) || (ppu_wr && !last_ppu_wr)) {
+			(ppu_wr ? cur->sdram_ppu_wr : cur->sdram_ppu_rd)[ppu_a >> 14 & 255]++;
+			last_ppu_req = clocks;
+			if (clocks - last_cpu_req < 2)
+				cur->contended++;
+		}
+		last_cpu_rd = cpu_rd;
+		last_cpu_wr = cpu_wr;
+		last_ppu_rd = ppu_rd;
+		last_ppu_wr = ppu_wr;
+	}
+
+	// hands the frame's counters to the writer
+	void end_frame(uint32_t frame);
+
+	uint64_t frames = 0;            // frames profiled
+	uint64_t stalls = 0;            // times the sim waited for the writer
+
+private:
+	void next_slot();
+	void worker();
+	void add_column(const BusFrame &b);
+	void write_totals();
+	void write_heatmap();
+
+	bool running = false;
+	BusFrame *cur = NULL;
+	uint32_t last_frame = 0;
+	int64_t clocks = 0, last_cpu_req = -2, last_ppu_req = -2;
+	bool last_cpu_rd = false, last_cpu_wr = false, last_ppu_rd = false, last_ppu_wr = false;
+	SpscRing<BusFrame, 64> ring;
+	std::atomic<bool> stopping{false};
+	std::thread thread;
+	std::string prefix;
+	FILE *f = NULL;                 // P_frames.csv
+
+	// writer side: totals, and the heatmap columns (CPU pages, then SDRAM bins) of
+	// group frames each. When there are too many, neighbours are merged.
+	BusCounts<uint64_t> total;
+	std::vector<uint64_t> columns;
+	uint32_t group = 1, in_last = 0;        // frames per column, and in the last one
+};
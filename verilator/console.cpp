@@ -0,0 +1,129 @@
+// Command input from stdin and a Unix socket, see console.h
+
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <poll.h>
+#include <csignal>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "console.h"
+
+using namespace std;
+
+bool Console::listen(const char *p) {
+	sockaddr_un addr = {};
+	if (strlen(p) >= sizeof(addr.sun_path)) {
+		::printf("Socket path too long: %s\n", p);
+		return false;
+	}
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, p);
+	unlink(p);
+	listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listen_fd < 0 || bind(listen_fd, (sockaddr *)&addr, sizeof(addr)) < 0 || ::listen(listen_fd, 1) < 0) {
+		perror(p);
+		return false;
+	}
+	path = p;
+	in_stdin.fd = 0;
+	signal(SIGPIPE, SIG_IGN);       // a client going away must not kill the sim
+	return true;
+}
+
+void Console::close() {
+	if (client.fd >= 0)
+		::close(client.fd);
+	if (listen_fd >= 0) {
+		::close(listen_fd);
+		unlink(path.c_str());
+	}
+	client.fd = listen_fd = -1;
+}
+
+bool Console::take_line(Input &in, string &line) {
+	size_t nl = in.buf.find('\n');
+	if (nl == string::npos)
+		return false;
+	line = in.buf.substr(0, nl);
+	in.buf.erase(0, nl + 1);
+	if (!line.empty() && line.back() == '\r')
+		line.pop_back();
+	return true;
+}
+
+// read what is available, false on EOF
+bool Console::fill(Input &in) {
+	char b[4096];
+	ssize_t n = read(in.fd, b, sizeof(b));
+	if (n <= 0)
+		return false;
+	in.buf.append(b, n);
+	return true;
+}
+
+bool Console::read_line(string &line) {
+	if (listen_fd < 0) {
+		// no socket, plain blocking stdin
+		from_client = false;
+		char b[4096];
+		if (!fgets(b, sizeof(b), stdin))
+			return false;
+		line = b;
+		while (!line.empty() && (line.back() == '\n' || line.back() == '\r'))
+			line.pop_back();
+		return true;
+	}
+	fflush(stdout);
+	while (true) {
+		if (take_line(in_stdin, line)) {
+			from_client = false;
+			return true;
+		}
+		if (client.fd >= 0 && take_line(client, line)) {
+			from_client = true;
+			return true;
+		}
+		pollfd fds[3];
+		int n = 0;
+		if (stdin_open)
+			fds[n++] = {0, POLLIN, 0};
+		fds[n++] = {client.fd >= 0 ? client.fd : listen_fd, POLLIN, 0};
+		if (poll(fds, n, -1) < 0)
+			return false;
+		for (int i = 0; i < n; i++) {
+			if (!(fds[i].revents & (POLLIN | POLLHUP)))
+				continue;
+			if (fds[i].fd == 0) {
+				if (!fill(in_stdin))
+					stdin_open = false;
+			} else if (fds[i].fd == listen_fd) {
+				client.fd = accept(listen_fd, NULL, NULL);
+				client.buf.clear();
+			} else if (!fill(client)) {
+				::close(client.fd);
+				client.fd = -1;
+			}
+		}
+	}
+}
+
+void Console::printf(const char *fmt, ...) {
+	char b[4096];
+	va_list ap;
+	va_start(ap, fmt);
+	vsnprintf(b, sizeof(b), fmt, ap);
+	va_end(ap);
+	fputs(b, stdout);
+	if (from_client && client.fd >= 0)
+		(void)!write(client.fd, b, strlen(b));
+}
+
+void Console::done(bool ok) {
+	if (from_client && client.fd >= 0) {
+		const char *s = ok ? "ok\n" : "error\n";
+		(void)!write(client.fd, s, strlen(s));
+	}
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+// Command input for the simulator prompt: lines come from stdin and, with
+// sim_main -U PATH, from clients of a local Unix socket (one at a time).
+// Output goes to stdout and to the client that sent the current command.
+// Socket clients get a final "ok" or "error" line after each command, so
+// scripts know when a long run has finished.
+
+#include <string>
+
+class Console {
+public:
+	bool listen(const char *path);
+	void close();
+
+	// next command line, false when stdin is closed and there is no socket
+	bool read_line(std::string &line);
+	void printf(const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+	void done(bool ok);
+
+	bool has_socket() const { return listen_fd >= 0; }
+
+private:
+	struct Input {
+		int fd = -1;
+		std::string buf;
+	};
+	bool take_line(Input &in, std::string &line);
+	bool fill(Input &in);
+
+	std::string path;
+	int listen_fd = -1;
+	Input in_stdin, client;
+	bool stdin_open = true;
+	bool from_client = false;       // current command came from the socket
+};
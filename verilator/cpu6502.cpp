@@ -0,0 +1,312 @@
+// 6502 opcode table, disassembler and reference model, see cpu6502.h
+
+#include <cstdio>
+
+#include "cpu6502.h"
+
+using namespace std;
+
+// Unofficial opcodes use the names from nestest.log and the NESdev wiki
+const OpInfo op_info[256] = {
+	{"BRK", AM_IMP, false}, {"ORA", AM_IZX, false}, {"KIL", AM_IMP, true}, {"SLO", AM_IZX, true},   // 00
+	{"NOP", AM_ZP, true}, {"ORA", AM_ZP, false}, {"ASL", AM_ZP, false}, {"SLO", AM_ZP, true},
+	{"PHP", AM_IMP, false}, {"ORA", AM_IMM, false}, {"ASL", AM_ACC, false}, {"ANC", AM_IMM, true},
+	{"NOP", AM_ABS, true}, {"ORA", AM_ABS, false}, {"ASL", AM_ABS, false}, {"SLO", AM_ABS, true},
+	{"BPL", AM_REL, false}, {"ORA", AM_IZY, false}, {"KIL", AM_IMP, true}, {"SLO", AM_IZY, true},   // 10
+	{"NOP", AM_ZPX, true}, {"ORA", AM_ZPX, false}, {"ASL", AM_ZPX, false}, {"SLO", AM_ZPX, true},
+	{"CLC", AM_IMP, false}, {"ORA", AM_ABY, false}, {"NOP", AM_IMP, true}, {"SLO", AM_ABY, true},
+	{"NOP", AM_ABX, true}, {"ORA", AM_ABX, false}, {"ASL", AM_ABX, false}, {"SLO", AM_ABX, true},
+	{"JSR", AM_ABS, false}, {"AND", AM_IZX, false}, {"KIL", AM_IMP, true}, {"RLA", AM_IZX, true},   // 20
+	{"BIT", AM_ZP, false}, {"AND", AM_ZP, false}, {"ROL", AM_ZP, false}, {"RLA", AM_ZP, true},
+	{"PLP", AM_IMP, false}, {"AND", AM_IMM, false}, {"ROL", AM_ACC, false}, {"ANC", AM_IMM, true},
+	{"BIT", AM_ABS, false}, {"AND", AM_ABS, false}, {"ROL", AM_ABS, false}, {"RLA", AM_ABS, true},
+	{"BMI", AM_REL, false}, {"AND", AM_IZY, false}, {"KIL", AM_IMP, true}, {"RLA", AM_IZY, true},   // 30
+	{"NOP", AM_ZPX, true}, {"AND", AM_ZPX, false}, {"ROL", AM_ZPX, false}, {"RLA", AM_ZPX, true},
+	{"SEC", AM_IMP, false}, {"AND", AM_ABY, false}, {"NOP", AM_IMP, true}, {"RLA", AM_ABY, true},
+	{"NOP", AM_ABX, true}, {"AND", AM_ABX, false}, {"ROL", AM_ABX, false}, {"RLA", AM_ABX, true},
+	{"RTI", AM_IMP, false}, {"EOR", AM_IZX, false}, {"KIL", AM_IMP, true}, {"SRE", AM_IZX, true},   // 40
+	{"NOP", AM_ZP, true}, {"EOR", AM_ZP, false}, {"LSR", AM_ZP, false}, {"SRE", AM_ZP, true},
+	{"PHA", AM_IMP, false}, {"EOR", AM_IMM, false}, {"LSR", AM_ACC, false}, {"ALR", AM_IMM, true},
+	{"JMP", AM_ABS, false}, {"EOR", AM_ABS, false}, {"LSR", AM_ABS, false}, {"SRE", AM_ABS, true},
+	{"BVC", AM_REL, false}, {"EOR", AM_IZY, false}, {"KIL", AM_IMP, true}, {"SRE", AM_IZY, true},   // 50
+	{"NOP", AM_ZPX, true}, {"EOR", AM_ZPX, false}, {"LSR", AM_ZPX, false}, {"SRE", AM_ZPX, true},
+	{"CLI", AM_IMP, false}, {"EOR", AM_ABY, false}, {"NOP", AM_IMP, true}, {"SRE", AM_ABY, true},
+	{"NOP", AM_ABX, true}, {"EOR", AM_ABX, false}, {"LSR", AM_ABX, false}, {"SRE", AM_ABX, true},
+	{"RTS", AM_IMP, false}, {"ADC", AM_IZX, false}, {"KIL", AM_IMP, true}, {"RRA", AM_IZX, true},   // 60
+	{"NOP", AM_ZP, true}, {"ADC", AM_ZP, false}, {"ROR", AM_ZP, false}, {"RRA", AM_ZP, true},
+	{"PLA", AM_IMP, false}, {"ADC", AM_IMM, false}, {"ROR", AM_ACC, false}, {"ARR", AM_IMM, true},
+	{"JMP", AM_IND, false}, {"ADC", AM_ABS, false}, {"ROR", AM_ABS, false}, {"RRA", AM_ABS, true},
+	{"BVS", AM_REL, false}, {"ADC", AM_IZY, false}, {"KIL", AM_IMP, true}, {"RRA", AM_IZY, true},   // 70
+	{"NOP", AM_ZPX, true}, {"ADC", AM_ZPX, false}, {"ROR", AM_ZPX, false}, {"RRA", AM_ZPX, true},
+	{"SEI", AM_IMP, false}, {"ADC", AM_ABY, false}, {"NOP", AM_IMP, true}, {"RRA", AM_ABY, true},
+	{"NOP", AM_ABX, true}, {"ADC", AM_ABX, false}, {"ROR", AM_ABX, false}, {"RRA", AM_ABX, true},
+	{"NOP", AM_IMM, true}, {"STA", AM_IZX, false}, {"NOP", AM_IMM, true}, {"SAX", AM_IZX, true},   // 80
+	{"STY", AM_ZP, false}, {"STA", AM_ZP, false}, {"STX", AM_ZP, false}, {"SAX", AM_ZP, true},
+	{"DEY", AM_IMP, false}, {"NOP", AM_IMM, true}, {"TXA", AM_IMP, false}, {"XAA", AM_IMM, true},
+	{"STY", AM_ABS, false}, {"STA", AM_ABS, false}, {"STX", AM_ABS, false}, {"SAX", AM_ABS, true},
+	{"BCC", AM_REL, false}, {"STA", AM_IZY, false}, {"KIL", AM_IMP, true}, {"AHX", AM_IZY, true},   // 90
+	{"STY", AM_ZPX, false}, {"STA", AM_ZPX, false}, {"STX", AM_ZPY, false}, {"SAX", AM_ZPY, true},
+	{"TYA", AM_IMP, false}, {"STA", AM_ABY, false}, {"TXS", AM_IMP, false}, {"TAS", AM_ABY, true},
+	{"SHY", AM_ABX, true}, {"STA", AM_ABX, false}, {"SHX", AM_ABY, true}, {"AHX", AM_ABY, true},
+	{"LDY", AM_IMM, false}, {"LDA", AM_IZX, false}, {"LDX", AM_IMM, false}, {"LAX", AM_IZX, true},   // A0
+	{"LDY", AM_ZP, false}, {"LDA", AM_ZP, false}, {"LDX", AM_ZP, false}, {"LAX", AM_ZP, true},
+	{"TAY", AM_IMP, false}, {"LDA", AM_IMM, false}, {"TAX", AM_IMP, false}, {"LXA", AM_IMM, true},
+	{"LDY", AM_ABS, false}, {"LDA", AM_ABS, false}, {"LDX", AM_ABS, false}, {"LAX", AM_ABS, true},
+	{"BCS", AM_REL, false}, {"LDA", AM_IZY, false}, {"KIL", AM_IMP, true}, {"LAX", AM_IZY, true},   // B0
+	{"LDY", AM_ZPX, false}, {"LDA", AM_ZPX, false}, {"LDX", AM_ZPY, false}, {"LAX", AM_ZPY, true},
+	{"CLV", AM_IMP, false}, {"LDA", AM_ABY, false}, {"TSX", AM_IMP, false}, {"LAS", AM_ABY, true},
+	{"LDY", AM_ABX, false}, {"LDA", AM_ABX, false}, {"LDX", AM_ABY, false}, {"LAX", AM_ABY, true},
+	{"CPY", AM_IMM, false}, {"CMP", AM_IZX, false}, {"NOP", AM_IMM, true}, {"DCP", AM_IZX, true},   // C0
+	{"CPY", AM_ZP, false}, {"CMP", AM_ZP, false}, {"DEC", AM_ZP, false}, {"DCP", AM_ZP, true},
+	{"INY", AM_IMP, false}, {"CMP", AM_IMM, false}, {"DEX", AM_IMP, false}, {"AXS", AM_IMM, true},
+	{"CPY", AM_ABS, false}, {"CMP", AM_ABS, false}, {"DEC", AM_ABS, false}, {"DCP", AM_ABS, true},
+	{"BNE", AM_REL, false}, {"CMP", AM_IZY, false}, {"KIL", AM_IMP, true}, {"DCP", AM_IZY, true},   // D0
+	{"NOP", AM_ZPX, true}, {"CMP", AM_ZPX, false}, {"DEC", AM_ZPX, false}, {"DCP", AM_ZPX, true},
+	{"CLD", AM_IMP, false}, {"CMP", AM_ABY, false}, {"NOP", AM_IMP, true}, {"DCP", AM_ABY, true},
+	{"NOP", AM_ABX, true}, {"CMP", AM_ABX, false}, {"DEC", AM_ABX, false}, {"DCP", AM_ABX, true},
+	{"CPX", AM_IMM, false}, {"SBC", AM_IZX, false}, {"NOP", AM_IMM, true}, {"ISB", AM_IZX, true},   // E0
+	{"CPX", AM_ZP, false}, {"SBC", AM_ZP, false}, {"INC", AM_ZP, false}, {"ISB", AM_ZP, true},
+	{"INX", AM_IMP, false}, {"SBC", AM_IMM, false}, {"NOP", AM_IMP, false}, {"SBC", AM_IMM, true},
+	{"CPX", AM_ABS, false}, {"SBC", AM_ABS, false}, {"INC", AM_ABS, false}, {"ISB", AM_ABS, true},
+	{"BEQ", AM_REL, false}, {"SBC", AM_IZY, false}, {"KIL", AM_IMP, true}, {"ISB", AM_IZY, true},   // F0
+	{"NOP", AM_ZPX, true}, {"SBC", AM_ZPX, false}, {"INC", AM_ZPX, false}, {"ISB", AM_ZPX, true},
+	{"SED", AM_IMP, false}, {"SBC", AM_ABY, false}, {"NOP", AM_IMP, true}, {"ISB", AM_ABY, true},
+	{"NOP", AM_ABX, true}, {"SBC", AM_ABX, false}, {"INC", AM_ABX, false}, {"ISB", AM_ABX, true},
+};
+
+int op_length(uint8_t op) {
+	switch (op_info[op].mode) {
+	case AM_IMP: case AM_ACC: return 1;
+	case AM_ABS: case AM_ABX: case AM_ABY: case AM_IND: return 3;
+	default: return 2;
+	}
+}
+
+string disasm(uint16_t pc, uint8_t op, uint8_t b1, uint8_t b2) {
+	const OpInfo &o = op_info[op];
+	uint16_t w = b1 | b2 << 8;
+	char s[32];
+	switch (o.mode) {
+	case AM_IMP: snprintf(s, sizeof(s), "%s", o.name); break;
+	case AM_ACC: snprintf(s, sizeof(s), "%s A", o.name); break;
+	case AM_IMM: snprintf(s, sizeof(s), "%s #$%02X", o.name, b1); break;
+	case AM_ZP:  snprintf(s, sizeof(s), "%s $%02X", o.name, b1); break;
+	case AM_ZPX: snprintf(s, sizeof(s), "%s $%02X,X", o.name, b1); break;
+	case AM_ZPY: snprintf(s, sizeof(s), "%s $%02X,Y", o.name, b1); break;
+	case AM_ABS: snprintf(s, sizeof(s), "%s $%04X", o.name, w); break;
+	case AM_ABX: snprintf(s, sizeof(s), "%s $%04X,X", o.name, w); break;
+	case AM_ABY: snprintf(s, sizeof(s), "%s $%04X,Y", o.name, w); break;
+	case AM_IND: snprintf(s, sizeof(s), "%s ($%04X)", o.name, w); break;
+	case AM_IZX: snprintf(s, sizeof(s), "%s ($%02X,X)", o.name, b1); break;
+	case AM_IZY: snprintf(s, sizeof(s), "%s ($%02X),Y", o.name, b1); break;
+	case AM_REL: snprintf(s, sizeof(s), "%s $%04X", o.name, (uint16_t)(pc + 2 + (int8_t)b1)); break;
+	}
+	return s;
+}
+
+// mnemonic as a number, for switch
+static constexpr uint32_t M(const char *n) {
+	return (uint32_t)n[0] << 16 | (uint32_t)n[1] << 8 | n[2];
+}
+
+void Ref6502::adc(uint8_t v) {
+	unsigned sum = a + v + (p & FC);
+	flag(FV, ~(a ^ v) & (a ^ sum) & 0x80);
+	flag(FC, sum > 0xff);
+	a = sum;
+	nz(a);
+}
+
+void Ref6502::cmp(uint8_t r, uint8_t v) {
+	flag(FC, r >= v);
+	nz(r - v);
+}
+
+void Ref6502::interrupt(Bus6502 &bus, uint16_t vector) {
+	push(bus, pc >> 8);
+	push(bus, pc);
+	push(bus, (p & ~FB) | FU);
+	p |= FI;
+	pc = bus.read(vector) | bus.read(vector + 1) << 8;
+}
+
+bool Ref6502::step(Bus6502 &bus) {
+	uint8_t op = bus.read(pc++);
+	const OpInfo &o = op_info[op];
+
+	// effective address
+	uint16_t ea = 0, t;
+	switch (o.mode) {
+	case AM_IMP: case AM_ACC: break;
+	case AM_IMM: ea = pc++; break;
+	case AM_ZP:  ea = bus.read(pc++); break;
+	case AM_ZPX: ea = (uint8_t)(bus.read(pc++) + x); break;
+	case AM_ZPY: ea = (uint8_t)(bus.read(pc++) + y); break;
+	case AM_ABS: case AM_ABX: case AM_ABY: case AM_IND:
+		ea = bus.read(pc) | bus.read(pc + 1) << 8;
+		pc += 2;
+		if (o.mode == AM_ABX)
+			ea += x;
+		else if (o.mode == AM_ABY)
+			ea += y;
+		else if (o.mode == AM_IND)      // the page wrap bug
+			ea = bus.read(ea) | bus.read((ea & 0xff00) | ((ea + 1) & 0xff)) << 8;
+		break;
+	case AM_IZX:
+		t = (uint8_t)(bus.read(pc++) + x);
+		ea = bus.read(t) | bus.read((t + 1) & 0xff) << 8;
+		break;
+	case AM_IZY:
+		t = bus.read(pc++);
+		ea = (bus.read(t) | bus.read((t + 1) & 0xff) << 8) + y;
+		break;
+	case AM_REL: ea = pc++; break;
+	}
+
+	uint8_t v;
+	bool acc = o.mode == AM_ACC;
+	switch (M(o.name)) {
+	case M("LDA"): a = bus.read(ea); nz(a); break;
+	case M("LDX"): x = bus.read(ea); nz(x); break;
+	case M("LDY"): y = bus.read(ea); nz(y); break;
+	case M("LAX"): a = x = bus.read(ea); nz(a); break;
+	case M("STA"): bus.write(ea, a); break;
+	case M("STX"): bus.write(ea, x); break;
+	case M("STY"): bus.write(ea, y); break;
+	case M("SAX"): bus.write(ea, a & x); break;
+	case M("ADC"): adc(bus.read(ea)); break;
+	case M("SBC"): adc(~bus.read(ea)); break;
+	case M("AND"): a &= bus.read(ea); nz(a); break;
+	case M("ORA"): a |= bus.read(ea); nz(a); break;
+	case M("EOR"): a ^= bus.read(ea); nz(a); break;
+	case M("CMP"): cmp(a, bus.read(ea)); break;
+	case M("CPX"): cmp(x, bus.read(ea)); break;
+	case M("CPY"): cmp(y, bus.read(ea)); break;
+	case M("BIT"):
+		v = bus.read(ea);
+		p = (p & ~(FN | FV | FZ)) | (v & (FN | FV)) | ((a & v) ? 0 : FZ);
+		break;
+	case M("ASL"): case M("SLO"):
+		v = acc ? a : bus.read(ea);
+		flag(FC, v & 0x80);
+		v <<= 1;
+		goto shifted;
+	case M("LSR"): case M("SRE"):
+		v = acc ? a : bus.read(ea);
+		flag(FC, v & 1);
+		v >>= 1;
+		goto shifted;
+	case M("ROL"): case M("RLA"):
+		v = acc ? a : bus.read(ea);
+		t = v << 1 | (p & FC);
+		flag(FC, v & 0x80);
+		v = t;
+		goto shifted;
+	case M("ROR"): case M("RRA"):
+		v = acc ? a : bus.read(ea);
+		t = v >> 1 | (p & FC) << 7;
+		flag(FC, v & 1);
+		v = t;
+	shifted:
+		if (acc)
+			a = v;
+		else
+			bus.write(ea, v);
+		switch (M(o.name)) {
+		case M("SLO"): a |= v; nz(a); break;
+		case M("SRE"): a ^= v; nz(a); break;
+		case M("RLA"): a &= v; nz(a); break;
+		case M("RRA"): adc(v); break;
+		default: nz(v);
+		}
+		break;
+	case M("INC"): case M("ISB"):
+		v = bus.read(ea) + 1;
+		bus.write(ea, v);
+		if (o.name[0] == 'I' && o.name[1] == 'S')
+			adc(~v);
+		else
+			nz(v);
+		break;
+	case M("DEC"): case M("DCP"):
+		v = bus.read(ea) - 1;
+		bus.write(ea, v);
+		if (o.name[1] == 'C')
+			cmp(a, v);
+		else
+			nz(v);
+		break;
+	case M("INX"): nz(++x); break;
+	case M("INY"): nz(++y); break;
+	case M("DEX"): nz(--x); break;
+	case M("DEY"): nz(--y); break;
+	case M("TAX"): x = a; nz(x); break;
+	case M("TAY"): y = a; nz(y); break;
+	case M("TXA"): a = x; nz(a); break;
+	case M("TYA"): a = y; nz(a); break;
+	case M("TSX"): x = s; nz(x); break;
+	case M("TXS"): s = x; break;
+	case M("CLC"): p &= ~FC; break;
+	case M("SEC"): p |= FC; break;
+	case M("CLI"): p &= ~FI; break;
+	case M("SEI"): p |= FI; break;
+	case M("CLV"): p &= ~FV; break;
+	case M("CLD"): p &= ~FD; break;
+	case M("SED"): p |= FD; break;
+	case M("BPL"): case M("BMI"): case M("BVC"): case M("BVS"):
+	case M("BCC"): case M("BCS"): case M("BNE"): case M("BEQ"): {
+		// bits 7-6 of the opcode select N, V, C, Z, bit 5 the value to branch on
+		static const uint8_t flags[4] = {FN, FV, FC, FZ};
+		if (!(p & flags[op >> 6]) == !(op & 0x20))
+			pc += (int8_t)bus.read(ea);
+		break;
+	}
+	case M("JMP"): pc = ea; break;
+	case M("JSR"):
+		pc--;
+		push(bus, pc >> 8);
+		push(bus, pc);
+		pc = ea;
+		break;
+	case M("RTS"):
+		pc = pull(bus);
+		pc |= pull(bus) << 8;
+		pc++;
+		break;
+	case M("RTI"):
+		p = (pull(bus) & ~FB) | FU;
+		pc = pull(bus);
+		pc |= pull(bus) << 8;
+		break;
+	case M("BRK"):
+		pc++;
+		push(bus, pc >> 8);
+		push(bus, pc);
+		push(bus, p | FB | FU);
+		p |= FI;
+		pc = bus.read(0xfffe) | bus.read(0xffff) << 8;
+		break;
+	case M("PHA"): push(bus, a); break;
+	case M("PHP"): push(bus, p | FB | FU); break;
+	case M("PLA"): a = pull(bus); nz(a); break;
+	case M("PLP"): p = (pull(bus) & ~FB) | FU; break;
+	case M("NOP"): break;               // unofficial NOPs read ea, the value is unused
+	case M("ANC"): a &= bus.read(ea); nz(a); flag(FC, a & 0x80); break;
+	case M("ALR"): a &= bus.read(ea); flag(FC, a & 1); a >>= 1; nz(a); break;
+	case M("ARR"):
+		a = (a & bus.read(ea)) >> 1 | (p & FC) << 7;
+		nz(a);
+		flag(FC, a & 0x40);
+		flag(FV, ((a >> 6) ^ (a >> 5)) & 1);
+		break;
+	case M("AXS"):
+		v = bus.read(ea);
+		flag(FC, (a & x) >= v);
+		x = (a & x) - v;
+		nz(x);
+		break;
+	default:
+		return false;
+	}
+	return true;
+}
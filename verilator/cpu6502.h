@@ -0,0 +1,58 @@
+#pragma once
+
+// 6502 opcode table, disassembler and reference model, for the CPU trace
+// (cputrace.h) and the lockstep checker (cpucheck.h)
+
+#include <cstdint>
+#include <string>
+
+enum AddrMode {
+	AM_IMP, AM_ACC, AM_IMM, AM_ZP, AM_ZPX, AM_ZPY, AM_ABS, AM_ABX, AM_ABY,
+	AM_IND, AM_IZX, AM_IZY, AM_REL
+};
+
+struct OpInfo {
+	const char *name;
+	AddrMode mode;
+	bool illegal;                   // unofficial opcode, marked with * in nestest logs
+};
+
+extern const OpInfo op_info[256];
+
+// instruction length in bytes, 1-3
+int op_length(uint8_t op);
+
+// "LDA ($12),Y", "BNE $C0F2" (branch target from pc). Operand bytes b1, b2 as needed.
+std::string disasm(uint16_t pc, uint8_t op, uint8_t b1, uint8_t b2);
+
+// Memory for Ref6502
+class Bus6502 {
+public:
+	virtual uint8_t read(uint16_t addr) = 0;
+	virtual void write(uint16_t addr, uint8_t v) = 0;
+};
+
+// Instruction-level 6502 as in the 2A03 (no decimal mode), the reference for the
+// lockstep checker (cpucheck.h). Only the reads and writes an instruction needs
+// are done, no dummy cycles.
+class Ref6502 {
+public:
+	enum { FC = 1, FZ = 2, FI = 4, FD = 8, FB = 0x10, FU = 0x20, FV = 0x40, FN = 0x80 };
+
+	uint16_t pc = 0;
+	uint8_t a = 0, x = 0, y = 0, s = 0, p = 0;
+
+	// Run the instruction at pc. Returns false for opcodes that are not modelled
+	// (KIL and the unstable XAA, LXA, AHX, TAS, SHX, SHY, LAS).
+	bool step(Bus6502 &bus);
+	// NMI or IRQ entry through vector, with pc at the interrupted instruction
+	void interrupt(Bus6502 &bus, uint16_t vector);
+
+private:
+	void push(Bus6502 &bus, uint8_t v) { bus.write(0x100 | s--, v); }
+	uint8_t pull(Bus6502 &bus) { return bus.read(0x100 | ++s); }
+	void nz(uint8_t v) { p = (p & ~(FN | FZ)) | (v & FN) | (v ? 0 : FZ); }
+	void flag(uint8_t f, bool on) { p = on ? p | f : p & ~f; }
+	void adc(uint8_t v);
+	void cmp(uint8_t r, uint8_t v);
+};
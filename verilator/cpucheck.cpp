@@ -0,0 +1,156 @@
+// Lockstep 6502 checker, see cpucheck.h
+
+#include <cstdio>
+
+#include "cpucheck.h"
+
+using namespace std;
+
+// Serve the model's reads from what the T65 read, in order where possible
+uint8_t CpuChecker::read(uint16_t addr) {
+	for (size_t n = 0; n < cycles.size(); n++) {
+		size_t i = (rpos + n) % cycles.size();
+		if (cycles[i].rnw && cycles[i].addr == addr) {
+			rpos = i + 1;
+			return cycles[i].data;
+		}
+	}
+	char s[48];
+	snprintf(s, sizeof(s), "  model read $%04X, the T65 did not\n", addr);
+	diffs += s;
+	return 0;
+}
+
+void CpuChecker::write(uint16_t addr, uint8_t v) {
+	writes.push_back({addr, v});
+}
+
+// addresses in order of first write, each with its last value
+static vector<pair<uint16_t, uint8_t>> final_writes(const vector<pair<uint16_t, uint8_t>> &w) {
+	vector<pair<uint16_t, uint8_t>> r;
+	for (auto &x : w) {
+		bool found = false;
+		for (auto &y : r)
+			if (y.first == x.first) {
+				y.second = x.second;
+				found = true;
+			}
+		if (!found)
+			r.push_back(x);
+	}
+	return r;
+}
+
+static string writes_str(const vector<pair<uint16_t, uint8_t>> &w) {
+	string r;
+	char s[16];
+	for (auto &x : w) {
+		snprintf(s, sizeof(s), " $%04X=%02X", x.first, x.second);
+		r += s;
+	}
+	return w.empty() ? " none" : r;
+}
+
+// Run the model over the instruction that just completed. Registers are compared
+// one cycle later by compare(), when the T65 has written them back.
+void CpuChecker::check(uint16_t fetch) {
+	rpos = 0;
+	writes.clear();
+	diffs.clear();
+	for (size_t i = 1; i < cycles.size(); i++)
+		if (cycles[i].rnw && cycles[i].addr == (uint16_t)(cur.pc + 1))
+			cur.b1 = cycles[i].data;
+		else if (cycles[i].rnw && cycles[i].addr == (uint16_t)(cur.pc + 2))
+			cur.b2 = cycles[i].data;
+	history[hist_n++ % 16] = cur;
+
+	// An NMI or IRQ replaces the fetched opcode and does not step the PC, so the
+	// next cycle reads the fetch address again. Reading a vector is not enough:
+	// LDA $FFFA or JMP ($FFFE) do that too.
+	bool irq = cycles.size() > 1 && cycles[1].rnw && cycles[1].addr == cur.pc;
+	uint16_t vec = 0;
+	for (auto &c : cycles)
+		if (c.rnw && (c.addr == 0xfffa || c.addr == 0xfffc || c.addr == 0xfffe))
+			vec = c.addr;
+	if (vec == 0xfffc || (vec == 0xfffa && cur.op == 0 && !irq)) {
+		// reset (which has no fetch of its own), or NMI taking over a BRK: not
+		// modelled, start over from the T65. A plain read of $FFFC lands here too,
+		// costing one skipped instruction.
+		synced = false;
+		skipped++;
+		return;
+	}
+	if (irq && vec) {
+		ref.pc = cur.pc;
+		ref.interrupt(*this, vec);
+	} else if (!ref.step(*this)) {
+		synced = false;
+		skipped++;
+		return;
+	}
+	steps++;
+
+	char s[128];
+	if (ref.pc != fetch) {
+		snprintf(s, sizeof(s), "  next PC: T65 $%04X, model $%04X\n", fetch, ref.pc);
+		diffs += s;
+	}
+	vector<pair<uint16_t, uint8_t>> t65;
+	for (auto &c : cycles)
+		if (!c.rnw)
+			t65.push_back({c.addr, c.data});
+	auto tw = final_writes(t65), mw = final_writes(writes);
+	if (tw != mw)
+		diffs += "  writes: T65" + writes_str(tw) + ", model" + writes_str(mw) + "\n";
+	checked.swap(cycles);
+	compare_pending = true;
+}
+
+void CpuChecker::compare() {
+	compare_pending = false;
+	char s[128];
+	uint8_t t[5] = {(uint8_t)regs, (uint8_t)(regs >> 8), (uint8_t)(regs >> 16), (uint8_t)(regs >> 32),
+	                (uint8_t)((regs >> 24) & 0xcf)};
+	uint8_t m[5] = {ref.a, ref.x, ref.y, ref.s, (uint8_t)(ref.p & 0xcf)};
+	const char *names[5] = {"A", "X", "Y", "SP", "P"};
+	for (int i = 0; i < 5; i++)
+		if (t[i] != m[i]) {
+			snprintf(s, sizeof(s), "  %s: T65 $%02X, model $%02X\n", names[i], t[i], m[i]);
+			diffs += s;
+		}
+	if (!diffs.empty())
+		fail(diffs);
+}
+
+// take the T65 state, at the start of the current instruction
+void CpuChecker::load() {
+	ref.pc = cur.pc;
+	ref.a = cur.a;
+	ref.x = cur.x;
+	ref.y = cur.y;
+	ref.s = cur.s;
+	ref.p = cur.p;
+	synced = true;
+}
+
+void CpuChecker::fail(const string &what) {
+	errors++;
+	failed = true;
+	synced = false;
+	const CpuStep &bad = history[(hist_n - 1) % 16];
+	char s[160];
+	snprintf(s, sizeof(s), "CPU check: instruction at $%04X (%s) diverged, scanline %d dot %d\n",
+	         bad.pc, disasm(bad.pc, bad.op, bad.b1, bad.b2).c_str(), bad.scanline, bad.dot);
+	report = s + what;
+	report += "  recent instructions, registers before each:\n";
+	for (unsigned i = hist_n > 16 ? hist_n - 16 : 0; i < hist_n; i++) {
+		format_cpu_step(history[i % 16], s, sizeof(s));
+		report += string("    ") + s;
+	}
+	report += "  bus cycles of the failing instruction:";
+	for (auto &c : checked) {
+		snprintf(s, sizeof(s), " %c$%04X=%02X", c.rnw ? 'R' : 'W', c.addr, c.data);
+		report += s;
+	}
+	report += "\n";
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+// Lockstep 6502 checker (sim_main -K). Every instruction the T65 runs is also run
+// by the reference model in cpu6502.h, fed with the data the T65 read from the bus
+// during that instruction. After each instruction the checker compares:
+//   - the next PC (the next opcode fetch address)
+//   - A, X, Y, SP and P (NV-DIZC)
+//   - the bus writes: addresses in order of first write, and each final value
+//   - that every read the model does was also done by the T65
+// The first divergence is reported with the last instructions and the bus cycles
+// of the failing one. The model then takes the T65 registers and goes on, so one
+// bug does not flood the report. Interrupts are recognized by the cycle after the
+// opcode fetch, which reads the same PC again where an instruction reads PC+1.
+// Reset and the unstable unofficial opcodes are skipped the same way.
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "cpu6502.h"
+#include "cputrace.h"
+
+class CpuChecker : private Bus6502 {
+public:
+	void cycle(const CpuCycle &c, uint32_t scanline, uint32_t dot) {
+		ncycles++;
+		if (c.sync && c.rdy) {
+			// opcode fetch: the previous instruction is complete
+			if (have && synced)
+				check(c.addr);
+			cur = CpuStep();
+			cur.cycle = ncycles;
+			cur.pc = c.addr;
+			cur.op = c.data;
+			cur.scanline = scanline;
+			cur.dot = dot;
+			cycles.clear();
+			cycles.push_back(c);
+			have = true;
+			got_regs = false;
+			return;
+		}
+		if (!have)
+			return;
+		if (!got_regs) {
+			// registers as of the end of the previous instruction, see cputrace.h
+			regs = c.regs;
+			got_regs = true;
+			cur.a = regs;
+			cur.x = regs >> 8;
+			cur.y = regs >> 16;
+			cur.p = regs >> 24;
+			cur.s = regs >> 32;
+			if (compare_pending)
+				compare();
+			if (!synced)
+				load();
+		}
+		if (c.rdy)
+			cycles.push_back(c);
+	}
+
+	uint64_t steps = 0;             // instructions checked
+	uint64_t skipped = 0;           // instructions not checked (resyncs)
+	uint64_t errors = 0;            // diverging instructions
+	bool failed = false;            // set at a divergence, cleared by the harness
+	std::string report;             // the last divergence
+
+private:
+	uint8_t read(uint16_t addr) override;
+	void write(uint16_t addr, uint8_t v) override;
+	void check(uint16_t fetch);
+	void compare();
+	void load();
+	void fail(const std::string &what);
+
+	Ref6502 ref;
+	bool have = false, synced = false, got_regs = false, compare_pending = false;
+	uint64_t ncycles = 0;
+	CpuStep cur;
+	uint64_t regs = 0;
+	std::vector<CpuCycle> cycles;   // of the current instruction
+	std::vector<CpuCycle> checked;  // of the instruction waiting for compare()
+	size_t rpos = 0;
+	std::vector<std::pair<uint16_t, uint8_t>> writes;   // by the model
+	std::string diffs;              // found by check(), reported by compare()
+	CpuStep history[16];            // recent instructions, registers before each
+	unsigned hist_n = 0;
+};
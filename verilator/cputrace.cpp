@@ -0,0 +1,100 @@
+// Per-instruction CPU trace, see cputrace.h
+
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <zlib.h>
+
+#include "cputrace.h"
+#include "cpu6502.h"
+
+using namespace std;
+
+bool CpuTrace::start(const char *path) {
+	size_t len = strlen(path);
+	if (len > 3 && strcmp(path + len - 3, ".gz") == 0)
+		gz = gzopen(path, "wb");
+	else
+		f = fopen(path, "w");
+	if (!f && !gz) {
+		printf("Cannot open %s\n", path);
+		return false;
+	}
+	running = true;
+	thread = std::thread(&CpuTrace::worker, this);
+	return true;
+}
+
+void CpuTrace::emit() {
+	if (!blk) {
+		while (!(blk = blocks.push_slot())) {
+			stalls++;
+			this_thread::yield();
+		}
+		blk->n = 0;
+	}
+	blk->s[blk->n++] = cur;
+	steps++;
+	if (blk->n == BLOCK) {
+		blocks.push_commit();
+		blk = NULL;
+	}
+}
+
+int format_cpu_step(const CpuStep &s, char *out, size_t size) {
+	int len = op_length(s.op);
+	char bytes[16];
+	if (len == 1)
+		snprintf(bytes, sizeof(bytes), "%02X", s.op);
+	else if (len == 2)
+		snprintf(bytes, sizeof(bytes), "%02X %02X", s.op, s.b1);
+	else
+		snprintf(bytes, sizeof(bytes), "%02X %02X %02X", s.op, s.b1, s.b2);
+	return snprintf(out, size, "%04X  %-8s %c%-32sA:%02X X:%02X Y:%02X P:%02X SP:%02X PPU:%3d,%3d CYC:%llu\n",
+	                s.pc, bytes, op_info[s.op].illegal ? '*' : ' ', disasm(s.pc, s.op, s.b1, s.b2).c_str(),
+	                s.a, s.x, s.y, (s.p | 0x20) & ~0x10, s.s, s.scanline, s.dot, (unsigned long long)s.cycle);
+}
+
+void CpuTrace::worker() {
+	string text;
+	char line[128];
+	while (true) {
+		Block *b = blocks.front();
+		if (!b) {
+			if (stopping)
+				break;
+			this_thread::sleep_for(chrono::milliseconds(1));
+			continue;
+		}
+		text.clear();
+		for (int i = 0; i < b->n; i++)
+			text.append(line, format_cpu_step(b->s[i], line, sizeof(line)));
+		blocks.pop_commit();
+		if (gz)
+			gzwrite((gzFile)gz, text.data(), text.size());
+		else
+			fwrite(text.data(), 1, text.size(), f);
+	}
+}
+
+void CpuTrace::stop() {
+	if (!running)
+		return;
+	if (have)
+		emit();
+	if (blk && blk->n)
+		blocks.push_commit();
+	blk = NULL;
+	have = false;
+	stopping = true;
+	thread.join();
+	running = false;
+	if (gz)
+		gzclose((gzFile)gz);
+	if (f)
+		fclose(f);
+	gz = NULL;
+	f = NULL;
+	printf("CPU trace: %llu instructions, sim waited for the writer %llu times\n",
+	       (unsigned long long)steps, (unsigned long long)stalls);
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+// Per-instruction CPU trace (sim_main -C), in the layout of nestest.log:
+//
+//   C000  4C F5 C5  JMP $C5F5                       A:00 X:00 Y:00 P:24 SP:FD PPU:  0, 21 CYC:7
+//
+// Registers are the state before the instruction runs. P is shown with bit 5 set
+// and B clear, as in nestest.log. PPU is scanline, dot at the opcode fetch and CYC
+// counts CPU cycles from the start of the trace. Unlike nestest.log, the
+// disassembly has no "= value" part, so compare with e.g.
+//   diff <(cut -c1-14,49-73 ours.log) <(cut -c1-14,49-73 nestest.log)
+//
+// The sim thread only fills binary records. A writer thread formats them and
+// compresses with zlib if the file name ends in .gz. The trace is lossless:
+// if the writer falls behind, the sim waits for it.
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <thread>
+
+#include "ring.h"
+
+// One CPU cycle on the T65 pins, sampled just before the clock edge that ends it
+struct CpuCycle {
+	uint16_t addr;
+	uint8_t data;                   // read data, or write data when !rnw
+	bool rnw, sync, rdy;
+	uint64_t regs;                  // T65 Regs: {PC,S,P,Y,X,A}
+};
+
+// One instruction
+struct CpuStep {
+	uint64_t cycle;
+	uint16_t pc, scanline, dot;
+	uint8_t op, b1, b2;
+	uint8_t a, x, y, p, s;
+};
+
+// one line of the trace, with newline. Returns the length.
+int format_cpu_step(const CpuStep &s, char *out, size_t size);
+
+class CpuTrace {
+public:
+	static const int BLOCK = 4096;
+	struct Block {
+		int n;
+		CpuStep s[BLOCK];
+	};
+
+	bool start(const char *path);
+	void stop();
+	bool active() const { return running; }
+
+	void cycle(const CpuCycle &c, uint32_t scanline, uint32_t dot) {
+		cycles++;
+		if (c.sync && c.rdy) {
+			// opcode fetch: the previous instruction is complete
+			if (have)
+				emit();
+			cur = CpuStep();
+			cur.cycle = cycles;
+			cur.pc = c.addr;
+			cur.op = c.data;
+			cur.scanline = scanline;
+			cur.dot = dot;
+			have = need_regs = true;
+			got = 0;
+			return;
+		}
+		if (!have)
+			return;
+		if (need_regs) {
+			// T65 writes back the previous instruction's result at the end of the
+			// fetch cycle, so registers are read one cycle later
+			cur.a = c.regs;
+			cur.x = c.regs >> 8;
+			cur.y = c.regs >> 16;
+			cur.p = c.regs >> 24;
+			cur.s = c.regs >> 32;
+			need_regs = false;
+		}
+		if (c.rnw && c.rdy) {
+			if (c.addr == (uint16_t)(cur.pc + 1) && !(got & 1)) {
+				cur.b1 = c.data;
+				got |= 1;
+			} else if (c.addr == (uint16_t)(cur.pc + 2) && !(got & 2)) {
+				cur.b2 = c.data;
+				got |= 2;
+			}
+		}
+	}
+
+	uint64_t steps = 0;             // instructions traced
+	uint64_t stalls = 0;            // times the sim waited for the writer
+
+private:
+	void emit();
+	void worker();
+
+	bool running = false;
+	uint64_t cycles = 0;
+	CpuStep cur;
+	bool have = false, need_regs = false;
+	int got = 0;                    // operand bytes seen
+	Block *blk = NULL;
+	SpscRing<Block, 16> blocks;
+	std::atomic<bool> stopping{false};
+	std::thread thread;
+	FILE *f = NULL;
+	void *gz = NULL;                // gzFile
+};
@@ -0,0 +1,109 @@
+// Frame presentation for the simulator.
+// The sim thread publishes finished frames into a TripleBuffer. The main thread
+// converts and presents them at the display's own pace (VSYNC), so eval() never
+// waits for the monitor.
+
+#include <cstdio>
+#ifndef NO_SDL
+#include <SDL.h>
+#endif
+
+#include "display.h"
+
+using namespace std;
+
+#ifndef NO_SDL
+bool display_loop(TripleBuffer &fb, PpuViewBuffer *ppu, atomic<bool> &sim_done, atomic<bool> &quit) {
+    static Pixel screenbuffer[H_RES*V_RES];
+    static Pixel ppubuffer[PPU_VIEW_W*PPU_VIEW_H];
+
+    if (SDL_Init(SDL_INIT_VIDEO) < 0) {
+        printf("SDL init failed.\n");
+        return false;
+    }
+
+    SDL_Window* sdl_window = SDL_CreateWindow("NESTang", SDL_WINDOWPOS_CENTERED,
+        SDL_WINDOWPOS_CENTERED, H_RES*2, V_RES*2, SDL_WINDOW_SHOWN);
+    if (!sdl_window) {
+        printf("Window creation failed: %s\n", SDL_GetError());
+        return false;
+    }
+    SDL_Renderer* sdl_renderer = SDL_CreateRenderer(sdl_window, -1,
+        SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
+    if (!sdl_renderer) {
+        printf("Renderer creation failed: %s\n", SDL_GetError());
+        return false;
+    }
+
+    SDL_Texture* sdl_texture = SDL_CreateTexture(sdl_renderer, SDL_PIXELFORMAT_RGBA8888,
+        SDL_TEXTUREACCESS_STREAMING, H_RES, V_RES);
+    if (!sdl_texture) {
+        printf("Texture creation failed: %s\n", SDL_GetError());
+        return false;
+    }
+
+	// PPU viewer window, without vsync so it does not halve the main window's rate
+	SDL_Window *ppu_window = NULL;
+	SDL_Renderer *ppu_renderer = NULL;
+	SDL_Texture *ppu_texture = NULL;
+	if (ppu) {
+		ppu_window = SDL_CreateWindow("NESTang PPU", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
+			PPU_VIEW_W, PPU_VIEW_H, SDL_WINDOW_SHOWN);
+		ppu_renderer = ppu_window ? SDL_CreateRenderer(ppu_window, -1, SDL_RENDERER_ACCELERATED) : NULL;
+		ppu_texture = ppu_renderer ? SDL_CreateTexture(ppu_renderer, SDL_PIXELFORMAT_RGBA8888,
+			SDL_TEXTUREACCESS_STREAMING, PPU_VIEW_W, PPU_VIEW_H) : NULL;
+		if (!ppu_texture) {
+			printf("PPU viewer window creation failed: %s\n", SDL_GetError());
+			return false;
+		}
+	}
+
+	while (!sim_done) {
+		SDL_Event e;
+		while (SDL_PollEvent(&e)) {
+			if (e.type == SDL_QUIT)
+				quit = true;
+			// closing the main window ends the run, closing the viewer only hides it
+			if (e.type == SDL_WINDOWEVENT && e.window.event == SDL_WINDOWEVENT_CLOSE) {
+				if (e.window.windowID == SDL_GetWindowID(sdl_window))
+					quit = true;
+				else if (ppu_window)
+					SDL_HideWindow(ppu_window);
+			}
+		}
+		if (quit)
+			break;
+
+		const uint8_t *view = ppu ? ppu->acquire() : NULL;
+		if (view) {
+			convert_pixels(ppubuffer, view, PPU_VIEW_W*PPU_VIEW_H);
+			SDL_UpdateTexture(ppu_texture, NULL, ppubuffer, PPU_VIEW_W*sizeof(Pixel));
+			SDL_RenderClear(ppu_renderer);
+			SDL_RenderCopy(ppu_renderer, ppu_texture, NULL, NULL);
+			SDL_RenderPresent(ppu_renderer);
+		}
+
+		const uint8_t *frame = fb.acquire();
+		if (!frame) {
+			SDL_Delay(1);
+			continue;
+		}
+		convert_pixels(screenbuffer, frame, H_RES*V_RES);
+		SDL_UpdateTexture(sdl_texture, NULL, screenbuffer, H_RES*sizeof(Pixel));
+		SDL_RenderClear(sdl_renderer);
+		SDL_RenderCopy(sdl_renderer, sdl_texture, NULL, NULL);
+		SDL_RenderPresent(sdl_renderer);
+	}
+
+	if (ppu_window) {
+		SDL_DestroyTexture(ppu_texture);
+		SDL_DestroyRenderer(ppu_renderer);
+		SDL_DestroyWindow(ppu_window);
+	}
+    SDL_DestroyTexture(sdl_texture);
+    SDL_DestroyRenderer(sdl_renderer);
+    SDL_DestroyWindow(sdl_window);
+    SDL_Quit();
+	return true;
+}
+#endif
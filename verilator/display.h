@@ -0,0 +1,49 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "video.h"
+#include "ppuview.h"
+
+// Lock-free triple buffer of raw color index images, one producer (the sim
+// thread) and one consumer (the display). Neither side ever waits for the other;
+// the consumer always gets the newest published image.
+template <size_t N>
+class TripleBufferOf {
+public:
+	uint8_t *back() { return buf[back_i]; }
+	// hand the back buffer over to the consumer
+	void publish() { back_i = middle.exchange(back_i | FRESH) & 3; }
+	// newest image, or NULL if nothing new since last call
+	const uint8_t *acquire() {
+		if (!(middle.load() & FRESH))
+			return NULL;
+		front_i = middle.exchange(front_i) & 3;
+		return buf[front_i];
+	}
+
+private:
+	static const int FRESH = 4;
+	uint8_t buf[3][N];
+	int back_i = 0, front_i = 1;    // owned by producer / consumer
+	std::atomic<int> middle{2};     // buffer index | FRESH
+};
+
+typedef TripleBufferOf<H_RES*V_RES> TripleBuffer;
+typedef TripleBufferOf<PPU_VIEW_W*PPU_VIEW_H> PpuViewBuffer;
+
+// How the sim thread paces itself against the display
+enum Pacing {
+	PACE_TURBO,         // unthrottled, the display shows the newest frame
+	PACE_REALTIME,      // NTSC 60.0988 Hz
+	PACE_EVERY_N,       // unthrottled, only every Nth frame is handed to the display
+};
+
+#ifndef NO_SDL
+// Open the window and present frames from fb until sim_done is set or the window
+// is closed (quit is then set). With ppu, also a window with the PPU viewer sheets
+// from it. Must run on the main thread. Returns false if SDL setup fails.
+bool display_loop(TripleBuffer &fb, PpuViewBuffer *ppu, std::atomic<bool> &sim_done, std::atomic<bool> &quit);
+#endif
@@ -0,0 +1,49 @@
+// Frame capture and output of one NES, see frameout.h
+
+#include "frameout.h"
+
+using namespace std;
+
+// sim_main.cpp
+bool frame_selected(long long frame, const vector<pair<long long,long long>> &list);
+
+int FrameOutput::end_frame(long long frame) {
+	int status = 0;
+	bool converted = false;
+	if (hash_file || !golden.empty()) {
+		uint64_t h = frame_hash(frame_idx, H_RES*V_RES);
+		if (hash_file)
+			fprintf(hash_file, "%lld %016llx\n", frame, (unsigned long long)h);
+		auto it = golden.find(frame);
+		if (it != golden.end()) {
+			golden_checked++;
+			if (it->second != h) {
+				// written to the output dir so the runner can diff it
+				golden_mismatches++;
+				status = 3;
+				convert_pixels(pixels, frame_idx, H_RES*V_RES);
+				converted = true;
+				write("mismatch", frame);
+			}
+		}
+	}
+	if (frame_selected(frame, dump_frames)) {
+		if (!converted)
+			convert_pixels(pixels, frame_idx, H_RES*V_RES);
+		if (write("frame", frame))
+			frames_written++;
+		else
+			status = 2;
+	}
+	return status;
+}
+
+// pixels to DIR/<what>_<frame>.ppm
+bool FrameOutput::write(const char *what, long long frame) {
+	char fname[1024];
+	snprintf(fname, sizeof(fname), "%s/%s_%05lld.ppm", out_dir.c_str(), what, frame);
+	if (write_ppm(fname, pixels))
+		return true;
+	printf("%sCannot write %s\n", prefix.c_str(), fname);
+	return false;
+}
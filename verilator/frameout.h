@@ -0,0 +1,68 @@
+#pragma once
+
+// The picture of one NES and what the harness does with it: the PPU output is
+// sampled into a frame of 6-bit colors, and each finished frame is hashed (-g),
+// checked against golden hashes (-G) and written as PPM (-w, into -o DIR). The
+// input movie (-m) is played from here too, as it goes frame by frame.
+//
+// sim_main has one of these, and every -M instance (multi.h) its own.
+
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "movie.h"
+#include "video.h"
+
+struct FrameOutput {
+	// PPU position and output as of the last rising edge, saved in checkpoints
+	struct {
+		uint32_t scanline, cycle, color;
+	} dot = {511, 511, 0};
+	uint8_t frame_idx[H_RES*V_RES];                 // raw 6-bit colors
+	Pixel pixels[H_RES*V_RES];                      // frame_idx converted, for PPM
+
+	std::vector<std::pair<long long,long long>> dump_frames;       // -w: frames to write
+	std::string out_dir = ".";                      // -o
+	FILE *hash_file = NULL;                         // -g: frame hashes written here
+	std::map<long long,uint64_t> golden;            // -G: expected hash by frame number
+	std::shared_ptr<const InputMovie> movie;        // -m, NULL means no buttons pressed
+	std::string prefix;                             // of messages, "job N: " in -M
+	int frames_written = 0, golden_checked = 0, golden_mismatches = 0;
+
+	// Once per rising edge of the master clock: records a dot's color when the PPU
+	// moves on to the next dot, and returns true then.
+	template <class NES>
+	bool clock(const NES *nes) {
+		uint32_t cycle = nes->cycle;
+		bool next = cycle != dot.cycle;
+		if (next) {
+			if (dot.scanline < V_RES && dot.cycle < H_RES)
+				frame_idx[dot.scanline*H_RES + dot.cycle] = dot.color;
+			dot.cycle = cycle;
+			dot.scanline = nes->scanline;
+		}
+		dot.color = nes->color;
+		return next;
+	}
+	// the dot just started ends the frame (start of vblank)
+	bool frame_end() const { return dot.scanline == V_RES && dot.cycle == 0; }
+
+	// controller state for frame from the movie
+	template <class TOP>
+	void apply_input(TOP *top, long long frame) const {
+		if (!movie)
+			return;
+		top->nestang_top->sim_joy1 = movie->p1(frame);
+		top->nestang_top->sim_joy2 = movie->p2(frame);
+	}
+
+	// Hash, check and write finished frame. Returns 0, 3 for a golden mismatch
+	// or 2 if a frame cannot be written.
+	int end_frame(long long frame);
+	bool write(const char *what, long long frame);
+};
@@ -0,0 +1,161 @@
+// iNES parsing for the simulator's backdoor ROM loading.
+// This mirrors what GameLoader (src/game_loader.v) does in hardware, so that
+// a ROM written directly into simulated SDRAM behaves the same as one streamed in.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <cctype>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "ines.h"
+
+using namespace std;
+
+// size code used by mapper_flags: 0 => 1 page, 1 => 2 pages, ... 7 => >64 pages
+static int size_code(int pages) {
+	int code = 0;
+	while (code < 7 && pages > (1 << code))
+		code++;
+	return code;
+}
+
+uint64_t ines_mapper_flags(const uint8_t *ines) {
+	int prgrom = ines[4], chrrom = ines[5];
+	bool is_nes20 = (ines[7] & 0x0c) == 0x08;
+	bool is_dirty = !is_nes20 && ((ines[9] & 0xfe) || ines[10] || ines[11] || ines[12] ||
+	                              ines[13] || ines[14] || ines[15]);
+	uint64_t mapper = (is_dirty ? 0 : (ines[7] & 0xf0)) | (ines[6] >> 4);
+	uint64_t ines2mapper = is_nes20 ? ines[8] : 0;
+	uint64_t prgram = is_nes20 ? (ines[10] & 0xf) : 0;
+	uint64_t prg_nvram = is_nes20 ? (ines[10] >> 4) : 0;
+	uint64_t piano = is_nes20 && (ines[15] & 0x3f) == 0x19;
+	uint64_t has_saves = (ines[6] >> 1) & 1;
+
+	return (prg_nvram << 31) | (piano << 30) | (prgram << 26) | (has_saves << 25) |
+	       (ines2mapper << 17) | ((uint64_t)((ines[6] >> 3) & 1) << 16) |
+	       ((uint64_t)(chrrom == 0) << 15) | ((uint64_t)(ines[6] & 1) << 14) |
+	       ((uint64_t)size_code(chrrom) << 11) | ((uint64_t)size_code(prgrom) << 8) | mapper;
+}
+
+// map the file read-only, so preloading the ROM into SDRAM needs no copy
+static bool map_file(const char *path, NesRom &rom) {
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat st;
+	void *p = MAP_FAILED;
+	if (fstat(fd, &st) == 0 && st.st_size > 0)
+		p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (p == MAP_FAILED)
+		return false;
+	size_t len = st.st_size;
+	rom.image = shared_ptr<const uint8_t>((const uint8_t *)p, [len](const uint8_t *q) { munmap((void *)q, len); });
+	rom.size = len;
+	return true;
+}
+
+// one hex byte per line
+static bool read_hex(const char *path, NesRom &rom) {
+	FILE *f = fopen(path, "r");
+	if (!f)
+		return false;
+	vector<uint8_t> data;
+	char line[64];
+	while (fgets(line, sizeof(line), f)) {
+		char *end;
+		if (!isxdigit((unsigned char)line[0]))
+			continue;
+		data.push_back((uint8_t)strtoul(line, &end, 16));
+	}
+	fclose(f);
+	uint8_t *p = new uint8_t[data.size()];
+	memcpy(p, data.data(), data.size());
+	rom.image = shared_ptr<const uint8_t>(p, default_delete<const uint8_t[]>());
+	rom.size = data.size();
+	return true;
+}
+
+bool load_rom(const char *path, NesRom &rom, string &err) {
+	rom = NesRom();
+	rom.path = path;
+	size_t len = strlen(path);
+	bool hex = len > 4 && strcasecmp(path + len - 4, ".hex") == 0;
+	if (!(hex ? read_hex(path, rom) : map_file(path, rom))) {
+		err = "cannot open file";
+		return false;
+	}
+
+	const uint8_t *ines = rom.image.get();
+	if (rom.size >= 4 && memcmp(ines, "FDS\x1a", 4) == 0) {
+		// no FDS mapper in the sim, nor the disk and BIOS loading of GameLoader
+		err = "FDS images are not supported";
+		return false;
+	}
+	if (rom.size < 16 || memcmp(ines, "NES\x1a", 4) != 0) {
+		err = "not an iNES file";
+		return false;
+	}
+	if (ines[6] & 4) {              // GameLoader does not support trainers either
+		err = "trainers are not supported";
+		return false;
+	}
+
+	rom.prg_offset = 16;
+	rom.prg_size = ines[4] * 16384;
+	rom.chr_offset = rom.prg_offset + rom.prg_size;
+	rom.chr_size = ines[5] * 8192;
+	if (rom.prg_size > SDRAM_PRG_MAX || rom.chr_size > SDRAM_CHR_MAX) {
+		err = "ROM too large";
+		return false;
+	}
+	if (rom.chr_offset + rom.chr_size > rom.size) {
+		err = "file is truncated";
+		return false;
+	}
+
+	rom.mapper_flags = ines_mapper_flags(ines);
+	rom.mapper = ((rom.mapper_flags >> 9) & 0x300) | (rom.mapper_flags & 0xff);
+	rom.submapper = (rom.mapper_flags >> 21) & 0xf;
+	rom.nes20 = (ines[7] & 0x0c) == 0x08;
+	return true;
+}
+
+// Mapper numbers of the families in cart.sv, as enabled there
+static const int NROM_MAPPERS[] = {0, 2, 3, 7, 28, 94, 97, 180, 185};
+static const int MMC1_MAPPERS[] = {1, 155, 171};
+static const int MMC3_MAPPERS[] = {4, 33, 37, 47, 48, 74, 76, 80, 82, 88, 95, 112, 118, 119, 154, 191,
+                                   192, 194, 195, 206, 207};
+
+template <size_t N>
+static bool in_list(const int (&list)[N], int mapper) {
+	return find(list, list + N, mapper) != list + N;
+}
+
+const char *mapper_variant(int mapper) {
+	if (in_list(NROM_MAPPERS, mapper))
+		return "nrom";
+	if (in_list(MMC1_MAPPERS, mapper))
+		return "mmc1";
+	if (in_list(MMC3_MAPPERS, mapper))
+		return "mmc3";
+	return NULL;
+}
+
+#define STRINGIFY(x) #x
+#define MODEL_MAPPERS(x) STRINGIFY(x)
+#ifdef SIM_MAPPERS
+const char *model_mappers = MODEL_MAPPERS(SIM_MAPPERS);
+#else
+const char *model_mappers = "all";
+#endif
+
+bool model_has_mapper(int mapper) {
+	const char *v = mapper_variant(mapper);
+	return strcmp(model_mappers, "all") == 0 || (v && strcmp(v, model_mappers) == 0);
+}
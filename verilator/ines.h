@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// SDRAM locations the game loader uses (see src/game_loader.v and src/cart.sv)
+const uint32_t SDRAM_PRG_BASE = 0x000000;
+const uint32_t SDRAM_CHR_BASE = 0x200000;
+const uint32_t SDRAM_PRG_MAX  = 0x200000;     // 2MB
+const uint32_t SDRAM_CHR_MAX  = 0x100000;     // 1MB, CHR-VRAM starts at 0x300000
+
+// A parsed iNES / NES 2.0 image
+struct NesRom {
+	std::string path;
+	std::shared_ptr<const uint8_t> image;   // whole file, mmap-ed read-only for .nes files
+	size_t size;
+	size_t prg_offset, prg_size;    // PRG ROM within image
+	size_t chr_offset, chr_size;    // CHR ROM within image, chr_size is 0 for CHR RAM
+	uint64_t mapper_flags;          // same encoding as GameLoader.mapper_flags
+	int mapper;                     // mapper number, {flags[18:17], flags[7:0]} as cart_top uses it
+	int submapper;                  // NES 2.0 submapper, flags[24:21]
+	bool nes20;
+
+	const uint8_t *prg() const { return image.get() + prg_offset; }
+	const uint8_t *chr() const { return image.get() + chr_offset; }
+};
+
+// Load a .nes file, or a .hex dump of one (one byte per line, as made by
+// hexdump -ve '1/1 "%02x\n"'). Returns false and sets err on failure.
+bool load_rom(const char *path, NesRom &rom, std::string &err);
+
+// Compute mapper_flags from a 16-byte iNES header, exactly as GameLoader does
+uint64_t ines_mapper_flags(const uint8_t *ines);
+
+// Mapper-specific models (verilator/Makefile MAPPERS=...) only have some of the
+// mapper families in cart.sv. mapper_variant() is the smallest model that has a
+// mapper: "nrom", "mmc1" or "mmc3", or NULL if only the full model does.
+// model_mappers is what this model was built with, "all" for the full model.
+const char *mapper_variant(int mapper);
+extern const char *model_mappers;
+bool model_has_mapper(int mapper);
@@ -0,0 +1,94 @@
+// Input movie loading, see movie.h
+
+#include <cstdio>
+#include <cstring>
+#include <strings.h>
+#include <fstream>
+
+#include "movie.h"
+
+using namespace std;
+
+// "RLDUTSBA" field of an .fm2 input line to sim_joy bits
+static bool fm2_buttons(const string &s, uint8_t &b) {
+	if (s.size() != 8)
+		return false;
+	b = 0;
+	for (int i = 0; i < 8; i++)
+		if (s[7-i] != '.' && s[7-i] != ' ')
+			b |= 1 << i;
+	return true;
+}
+
+static bool load_fm2(const char *path, InputMovie &m, string &err) {
+	ifstream f(path);
+	if (!f) {
+		err = "cannot open file";
+		return false;
+	}
+	string line;
+	int lineno = 0;
+	while (getline(f, line)) {
+		lineno++;
+		if (!line.empty() && line.back() == '\r')
+			line.pop_back();
+		if (line.empty())
+			continue;
+		if (line[0] != '|') {
+			// header: "key value"
+			if (line.compare(0, 7, "binary ") == 0 && line.substr(7) != "0") {
+				err = "binary .fm2 movies are not supported";
+				return false;
+			}
+			continue;
+		}
+		// |commands|port0|port1|port2|
+		vector<string> fields;
+		size_t pos = 1, bar;
+		while ((bar = line.find('|', pos)) != string::npos) {
+			fields.push_back(line.substr(pos, bar - pos));
+			pos = bar + 1;
+		}
+		uint8_t b1 = 0, b2 = 0;
+		if (fields.size() < 2 || (!fields[1].empty() && !fm2_buttons(fields[1], b1)) ||
+		    (fields.size() > 2 && !fields[2].empty() && !fm2_buttons(fields[2], b2))) {
+			err = "cannot parse input line " + to_string(lineno);
+			return false;
+		}
+		if (atoi(fields[0].c_str()) & 3)
+			m.resets++;
+		m.joy1.push_back(b1);
+		m.joy2.push_back(b2);
+	}
+	return true;
+}
+
+static bool load_binary(const char *path, InputMovie &m, string &err) {
+	FILE *f = fopen(path, "rb");
+	if (!f) {
+		err = "cannot open file";
+		return false;
+	}
+	uint8_t b[2];
+	size_t n;
+	while ((n = fread(b, 1, 2, f)) == 2) {
+		m.joy1.push_back(b[0]);
+		m.joy2.push_back(b[1]);
+	}
+	fclose(f);
+	if (n != 0) {
+		err = "odd file length, expecting 2 bytes per frame";
+		return false;
+	}
+	return true;
+}
+
+bool InputMovie::load(const char *path, string &err) {
+	joy1.clear();
+	joy2.clear();
+	resets = 0;
+	size_t len = strlen(path);
+	if (len > 4 && strcasecmp(path + len - 4, ".fm2") == 0)
+		return load_fm2(path, *this, err);
+	return load_binary(path, *this, err);
+}
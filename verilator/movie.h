@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Per-frame controller input for the simulator.
+//
+// Two formats are read:
+//  - FCEUX .fm2 text movies. Each |c|RLDUTSBA|RLDUTSBA|| line is one frame.
+//  - Raw binary (any other extension): 2 bytes per frame, player 1 then player 2,
+//    bit 0..7 = A, B, Select, Start, Up, Down, Left, Right (the order the NES
+//    shifts them out, and what nestang_top's sim_joy1/sim_joy2 take).
+//
+// Movie frame 0 is applied from frame `start` of the simulation on, and movie
+// frame k when the simulation completes frame start+k (start of vblank, before
+// the game reads the controllers in its NMI handler).
+struct InputMovie {
+	std::vector<uint8_t> joy1, joy2;
+	long long start = 0;
+	int resets = 0;                 // reset commands in an .fm2, which are not replayed
+
+	bool load(const char *path, std::string &err);
+
+	// buttons for simulation frame f, all released before the start and after the end
+	uint8_t p1(long long f) const { return in(f) ? joy1[f - start] : 0; }
+	uint8_t p2(long long f) const { return in(f) ? joy2[f - start] : 0; }
+	bool in(long long f) const { return f >= start && f - start < (long long)joy1.size(); }
+};
@@ -0,0 +1,266 @@
+// Many NES instances in one process on a work-stealing pool, see multi.h
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#include "Vnestang_top.h"
+#include "Vnestang_top_nestang_top.h"
+#include "Vnestang_top_NES.h"
+#include "verilated.h"
+#include "frameout.h"
+#include "multi.h"
+#include "sdram.h"
+
+using namespace std;
+
+// sim_main.cpp
+vector<string> tokenize(string s);
+bool parse_frame_list(string s, vector<pair<long long,long long>> &r);
+bool load_golden(const char *fname, map<long long,uint64_t> &golden);
+void preload_rom(Vnestang_top *top, SparseMem &mem, const NesRom &rom);
+
+static mutex print_lock;            // one JSON line at a time
+
+// A model with its own context and SDRAM, running one job
+class NesInstance {
+public:
+	explicit NesInstance(const InstanceJob &job);
+	~NesInstance();
+	int run();
+
+private:
+	void end_of_frame();
+
+	const InstanceJob &job;
+	VerilatedContext ctx;
+	Vnestang_top *top;
+	SparseMem mem_cpu{4*1024*1024};
+	SparseMem mem_rv{2*1024*1024};
+	FrameOutput out;
+
+	vluint64_t sim_time = 0;
+	int frame_count = 0;
+	int status = 0;
+};
+
+NesInstance::NesInstance(const InstanceJob &job) : job(job) {
+	top = new Vnestang_top(&ctx);
+	if (job.rom)
+		preload_rom(top, mem_cpu, *job.rom);
+	out.dump_frames = job.dump_frames;
+	out.out_dir = job.out_dir;
+	out.golden = job.golden;
+	out.movie = job.movie;
+	out.prefix = "job " + to_string(job.id) + ": ";
+}
+
+NesInstance::~NesInstance() {
+	delete top;
+	if (out.hash_file)
+		fclose(out.hash_file);
+}
+
+void NesInstance::end_of_frame() {
+	frame_count++;
+	out.apply_input(top, frame_count);
+	if (int s = out.end_frame(frame_count))
+		status = s;
+}
+
+// Run the job to its -c/-f limit and print its stats. Returns exit status.
+int NesInstance::run() {
+	if (!job.hash_path.empty() && !(out.hash_file = fopen(job.hash_path.c_str(), "w"))) {
+		printf("job %d: cannot open %s\n", job.id, job.hash_path.c_str());
+		return 1;
+	}
+	auto start = chrono::steady_clock::now();
+	sdram_bind(&mem_cpu, &mem_rv);
+	out.apply_input(top, frame_count);
+
+	// the run loop of sim_main.cpp without the hooks
+	Vnestang_top_NES *nes = top->nestang_top->nes;
+	while ((job.max_sim_time == 0 || sim_time < (vluint64_t)job.max_sim_time) &&
+	       (job.max_frames == 0 || frame_count < job.max_frames)) {
+		top->sys_clk ^= 1;
+		top->eval();
+		if (top->sys_clk && out.clock(nes) && out.frame_end())
+			end_of_frame();
+		sim_time++;
+	}
+	sdram_bind(&sdram_cpu, &sdram_rv);
+
+	double duration = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	lock_guard<mutex> l(print_lock);
+	printf("{\"job\":%d,\"frames\":%d,\"sim_time\":%llu,\"cycles\":%llu,\"wall_s\":%.3f,\"fps\":%.2f,"
+	       "\"cycles_per_sec\":%.0f,\"frames_written\":%d,\"golden_checked\":%d,\"golden_mismatches\":%d,"
+	       "\"sdram_pages\":%zu,\"status\":%d}\n",
+	       job.id, frame_count, (unsigned long long)sim_time, (unsigned long long)sim_time/2, duration,
+	       frame_count/duration, sim_time/2/duration, out.frames_written, out.golden_checked, out.golden_mismatches,
+	       mem_cpu.pages_used() + mem_rv.pages_used(), status);
+	fflush(stdout);
+	return status;
+}
+
+// Parse one job line. ROMs and movies are loaded once per file and shared.
+static bool parse_job(const vector<string> &args, InstanceJob &job,
+                      map<string,shared_ptr<const NesRom>> &roms,
+                      map<string,shared_ptr<const InputMovie>> &movies) {
+	for (size_t i = 0; i < args.size(); i++) {
+		const string &a = args[i];
+		bool has_arg = i+1 < args.size();
+		string err;
+		if (a == "-c" && has_arg) {
+			job.max_sim_time = strtoll(args[++i].c_str(), NULL, 10);
+		} else if (a == "-f" && has_arg) {
+			job.max_frames = strtoll(args[++i].c_str(), NULL, 10);
+		} else if (a == "-w" && has_arg) {
+			if (!parse_frame_list(args[++i], job.dump_frames)) {
+				printf("job %d: cannot parse frame list %s\n", job.id, args[i].c_str());
+				return false;
+			}
+		} else if (a == "-o" && has_arg) {
+			job.out_dir = args[++i];
+		} else if (a == "-g" && has_arg) {
+			job.hash_path = args[++i];
+		} else if (a == "-G" && has_arg) {
+			if (!load_golden(args[++i].c_str(), job.golden))
+				return false;
+		} else if (a == "-m" && has_arg) {
+			string path = args[++i];
+			long long start = 0;
+			size_t at = path.rfind('@');
+			if (at != string::npos) {
+				start = atoll(path.c_str() + at + 1);
+				path.resize(at);
+			}
+			auto &m = movies[path];
+			if (!m) {
+				InputMovie *movie = new InputMovie;
+				if (!movie->load(path.c_str(), err)) {
+					printf("job %d: cannot load movie %s: %s\n", job.id, path.c_str(), err.c_str());
+					delete movie;
+					movies.erase(path);
+					return false;
+				}
+				m.reset(movie);
+			}
+			if (m->start != start) {
+				// same data, another start frame
+				InputMovie *movie = new InputMovie(*m);
+				movie->start = start;
+				job.movie.reset(movie);
+			} else
+				job.movie = m;
+		} else if (a[0] != '-' && !job.rom) {
+			auto &r = roms[a];
+			if (!r) {
+				NesRom *rom = new NesRom;
+				if (!load_rom(a.c_str(), *rom, err)) {
+					printf("job %d: cannot load %s: %s\n", job.id, a.c_str(), err.c_str());
+					delete rom;
+					roms.erase(a);
+					return false;
+				}
+				r.reset(rom);
+			}
+			if (!model_has_mapper(r->mapper)) {
+				printf("job %d: this model is built with MAPPERS=%s and does not have mapper %d\n", job.id,
+				       model_mappers, r->mapper);
+				return false;
+			}
+			job.rom = r;
+		} else {
+			printf("job %d: unknown option %s\n", job.id, a.c_str());
+			return false;
+		}
+	}
+	if (job.max_sim_time == 0 && job.max_frames == 0) {
+		printf("job %d: needs -c or -f\n", job.id);
+		return false;
+	}
+	return true;
+}
+
+namespace {
+struct Worker {
+	mutex lock;
+	deque<InstanceJob *> jobs;
+};
+}
+
+// Next job for worker self: newest of its own, else the oldest of another worker
+static InstanceJob *take_job(vector<Worker> &workers, int self) {
+	for (size_t k = 0; k < workers.size(); k++) {
+		Worker &w = workers[(self + k) % workers.size()];
+		lock_guard<mutex> l(w.lock);
+		if (w.jobs.empty())
+			continue;
+		InstanceJob *j;
+		if (k == 0) {
+			j = w.jobs.back();
+			w.jobs.pop_back();
+		} else {
+			j = w.jobs.front();
+			w.jobs.pop_front();
+		}
+		return j;
+	}
+	return NULL;
+}
+
+int multi_run(const char *fname, int threads) {
+	auto start = chrono::steady_clock::now();
+	FILE *f = strcmp(fname, "-") == 0 ? stdin : fopen(fname, "r");
+	if (!f) {
+		printf("Cannot open %s\n", fname);
+		return 1;
+	}
+	map<string,shared_ptr<const NesRom>> roms;
+	map<string,shared_ptr<const InputMovie>> movies;
+	vector<unique_ptr<InstanceJob>> jobs;
+	char line[4096];
+	bool ok = true;
+	while (fgets(line, sizeof(line), f)) {
+		line[strcspn(line, "\r\n")] = 0;
+		vector<string> args = tokenize(line);
+		if (args.empty() || args[0][0] == '#')
+			continue;
+		InstanceJob *job = new InstanceJob;
+		job->id = jobs.size();
+		jobs.emplace_back(job);
+		ok = parse_job(args, *job, roms, movies) && ok;
+	}
+	if (f != stdin)
+		fclose(f);
+	if (!ok)
+		return 1;
+
+	int n = threads > 0 ? threads : max(1u, thread::hardware_concurrency());
+	n = min(n, max((int)jobs.size(), 1));
+	vector<Worker> workers(n);
+	for (size_t i = 0; i < jobs.size(); i++)
+		workers[i % n].jobs.push_back(jobs[i].get());
+
+	atomic<int> failed(0);
+	vector<thread> pool;
+	for (int w = 0; w < n; w++)
+		pool.emplace_back([&, w] {
+			while (InstanceJob *job = take_job(workers, w)) {
+				NesInstance inst(*job);
+				if (inst.run())
+					failed++;
+			}
+		});
+	for (auto &t : pool)
+		t.join();
+
+	double duration = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	printf("{\"jobs\":%zu,\"failed\":%d,\"threads\":%d,\"roms\":%zu,\"wall_s\":%.3f}\n",
+	       jobs.size(), (int)failed, n, roms.size(), duration);
+	return failed ? 4 : 0;
+}
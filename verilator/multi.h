@@ -0,0 +1,44 @@
+#pragma once
+
+// Many independent NES instances in one process (sim_main -M F -j N).
+//
+// Each line of the job file is one instance: its own VerilatedContext and model,
+// simulated SDRAM, input movie and outputs. ROM files are loaded once and shared
+// read-only: the PRG/CHR pages of every instance point into the same mmap-ed
+// image (SparseMem::map), so an instance costs the model plus the SDRAM pages it
+// writes.
+//
+// Instances run on a work-stealing pool. Each worker has a deque of jobs, filled
+// round robin. A worker takes jobs from the back of its own deque, and when that
+// is empty steals from the front of the others. A model is only created when its
+// job starts and freed when it ends, so at most N models exist at once.
+//
+// Needs the single-threaded model. DPI SDRAM calls find the instance's memory
+// through a per-thread binding (sdram_bind()), set before each instance runs.
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "ines.h"
+#include "movie.h"
+
+// One job line: [-c T] [-f N] [-w L] [-o DIR] [-g F] [-G F] [-m F[@N]] [game.nes]
+struct InstanceJob {
+	int id;
+	std::shared_ptr<const NesRom> rom;          // NULL: the compiled-in game
+	long long max_sim_time = 0;
+	long long max_frames = 0;
+	std::vector<std::pair<long long,long long>> dump_frames;
+	std::string out_dir = ".";
+	std::string hash_path;                      // -g
+	std::map<long long,uint64_t> golden;        // -G
+	std::shared_ptr<const InputMovie> movie;
+};
+
+// Run the jobs in file fname (- for stdin) with `threads` workers (0 means one
+// per core). Prints one JSON line per job and a summary. Returns exit status.
+int multi_run(const char *fname, int threads);
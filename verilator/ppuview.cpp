@@ -0,0 +1,128 @@
+// PPU debug views, see ppuview.h
+
+#include <cstring>
+
+#include "Vnestang_top.h"
+#include "verilated.h"
+#include "verilated_syms.h"
+#include "ppuview.h"
+#include "sdram.h"
+
+using namespace std;
+
+static const uint8_t BORDER = 0x2d;         // grey between the views
+
+// Find a public signal, checking its element type and array size
+static const void *find_signal(Vnestang_top *top, const char *scope_name, const char *name,
+                               VerilatedVarType type, int elements, string &err) {
+	const VerilatedScope *scope = top->contextp()->scopeFind(scope_name);
+	const VerilatedVar *var = scope ? scope->varFind(name) : NULL;
+	if (!var) {
+		err = string("no public signal ") + scope_name + "." + name;
+		return NULL;
+	}
+	int n = var->udims() ? var->elements(1) : 1;
+	if (var->vltype() != type || n != elements) {
+		err = string(scope_name) + "." + name + " has an unexpected type";
+		return NULL;
+	}
+	return var->datap();
+}
+
+bool PpuViewer::init(Vnestang_top *top, string &err) {
+	const char *ppu = "TOP.nestang_top.nes.ppu";
+	palette = NULL;
+	const void *p = find_signal(top, "TOP.nestang_top.nes.ppu.palette_ram", "palette", VLVT_UINT8, 32, err);
+	const void *o = p ? find_signal(top, "TOP.nestang_top.nes.ppu.sprite_ram", "oam", VLVT_UINT8, 256, err) : NULL;
+	const void *b = o ? find_signal(top, ppu, "bg_patt", VLVT_UINT8, 1, err) : NULL;
+	const void *op = b ? find_signal(top, ppu, "obj_patt", VLVT_UINT8, 1, err) : NULL;
+	const void *os = op ? find_signal(top, ppu, "obj_size", VLVT_UINT8, 1, err) : NULL;
+	const void *m = os ? find_signal(top, "TOP.nestang_top.nes", "chr_bank_map", VLVT_UINT16, 8, err) : NULL;
+	if (!m)
+		return false;
+	oam = (const uint8_t *)o;
+	bg_patt = (const uint8_t *)b;
+	obj_patt = (const uint8_t *)op;
+	obj_size = (const uint8_t *)os;
+	bank_map = (const uint16_t *)m;
+	palette = (const uint8_t *)p;
+	return true;
+}
+
+// pattern table byte at PPU address a
+uint8_t PpuViewer::chr(const SparseMem &mem, uint32_t a) const {
+	return mem.read8((uint32_t)(bank_map[a >> 10 & 7] & 0xfff) << 10 | (a & 0x3ff));
+}
+
+// palette RAM as the PPU reads it: pixel 0 of every palette is the backdrop
+uint8_t PpuViewer::color(int pal, int pix) const {
+	return palette[pix ? pal*4 + pix : 0] & 63;
+}
+
+// Draw the 8x8 tile at pattern address addr. Without opaque, pixel 0 is left alone.
+void PpuViewer::tile(uint8_t *out, int x, int y, const SparseMem &mem, uint32_t addr, int pal,
+                     bool opaque, bool hflip, bool vflip) const {
+	for (int r = 0; r < 8; r++) {
+		int yy = y + r;
+		if (yy < 0 || yy >= PPU_VIEW_H)
+			continue;
+		int row = vflip ? 7 - r : r;
+		uint8_t lo = chr(mem, addr + row), hi = chr(mem, addr + row + 8);
+		for (int c = 0; c < 8; c++) {
+			int bit = hflip ? c : 7 - c;
+			int pix = (lo >> bit & 1) | (hi >> bit & 1) << 1;
+			if (pix || opaque)
+				out[yy*PPU_VIEW_W + x + c] = color(pal, pix);
+		}
+	}
+}
+
+void PpuViewer::render(uint8_t *out, const SparseMem &mem) const {
+	memset(out, BORDER, PPU_VIEW_W*PPU_VIEW_H);
+
+	// nametables: 32x30 tiles each, attribute bytes after the tiles
+	uint32_t bg = *bg_patt ? 0x1000 : 0;
+	for (int nt = 0; nt < 2; nt++) {
+		uint32_t base = SDRAM_CHR_VRAM + nt*0x400;
+		for (int ty = 0; ty < 30; ty++)
+			for (int tx = 0; tx < 32; tx++) {
+				uint8_t t = mem.read8(base + ty*32 + tx);
+				uint8_t attr = mem.read8(base + 960 + (ty/4)*8 + tx/4);
+				int pal = attr >> ((ty & 2) << 1 | (tx & 2)) & 3;
+				tile(out, nt*256 + tx*8, ty*8, mem, bg + t*16, pal, true);
+			}
+	}
+
+	// pattern tables, with a background palette for the background's table and
+	// a sprite palette for the other
+	for (int pt = 0; pt < 2; pt++)
+		for (int t = 0; t < 256; t++)
+			tile(out, pt*128 + (t & 15)*8, 240 + (t >> 4)*8, mem, pt*0x1000 + t*16,
+			     (uint32_t)pt*0x1000 == bg ? 0 : 4, true);
+
+	// palette entries, 16x16 each, background then sprites
+	for (int i = 0; i < 32; i++)
+		for (int y = 1; y < 15; y++)
+			memset(&out[(376 + (i/16)*16 + y)*PPU_VIEW_W + (i%16)*16 + 1], palette[i] & 63, 14);
+
+	// sprites at their positions over the backdrop, sprite 0 on top
+	for (int y = 240; y < 480; y++)
+		memset(&out[y*PPU_VIEW_W + 256], color(0, 0), 256);
+	int h = *obj_size ? 16 : 8;
+	for (int i = 63; i >= 0; i--) {
+		const uint8_t *s = &oam[i*4];
+		int y = s[0] + 1, x = s[3];
+		if (y >= 240 || x > 248)            // off screen, or partly off the right edge
+			continue;
+		bool hflip = s[2] & 0x40, vflip = s[2] & 0x80;
+		int pal = 4 + (s[2] & 3);
+		if (h == 8)
+			tile(out, 256 + x, 240 + y, mem, (*obj_patt ? 0x1000 : 0) + s[1]*16, pal, false, hflip, vflip);
+		else {
+			// 8x16: table from bit 0 of the tile number, flipping also swaps the halves
+			uint32_t a = (s[1] & 1) * 0x1000 + (s[1] & 0xfe) * 16;
+			tile(out, 256 + x, 240 + y + (vflip ? 8 : 0), mem, a, pal, false, hflip, vflip);
+			tile(out, 256 + x, 240 + y + (vflip ? 0 : 8), mem, a + 16, pal, false, hflip, vflip);
+		}
+	}
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+// PPU debug views for the simulator (sim_main -d/-D, ppu prompt command).
+//
+// The viewer reads the PPU's palette RAM, OAM and control bits through their
+// public signals, the nametables from CIRAM and the pattern tables from CHR in
+// the simulated SDRAM. It only runs at frame boundaries or at the prompt, so the
+// run loop does not change. One 512x480 sheet of NES color indices is drawn:
+//   top           the two CIRAM nametables, with the background pattern table
+//   bottom left   pattern tables $0000 and $1000, then the 32 palette entries
+//   bottom right  the sprites in OAM at their screen positions
+// CHR is read through the bank mapping the PPU last fetched with, which nes.v
+// records per 1KB (chr_bank_map). So mid-frame CHR bank switches show the last
+// banks, and mapper nametables outside CIRAM (four-screen, MMC5 ExRAM) are not shown.
+
+#include <cstdint>
+#include <string>
+
+class SparseMem;
+class Vnestang_top;
+
+const int PPU_VIEW_W = 512;
+const int PPU_VIEW_H = 480;
+
+class PpuViewer {
+public:
+	// find the public signals, false with err if the model does not have them
+	bool init(Vnestang_top *top, std::string &err);
+	bool ready() const { return palette != NULL; }
+
+	// draw the sheet, PPU_VIEW_W*PPU_VIEW_H color indices
+	void render(uint8_t *out, const SparseMem &mem) const;
+
+private:
+	uint8_t chr(const SparseMem &mem, uint32_t a) const;
+	void tile(uint8_t *out, int x, int y, const SparseMem &mem, uint32_t addr, int pal,
+	          bool opaque, bool hflip = false, bool vflip = false) const;
+	uint8_t color(int pal, int pix) const;
+
+	const uint8_t *palette = NULL;          // 32 entries
+	const uint8_t *oam = NULL;              // 256 bytes
+	const uint8_t *bg_patt = NULL, *obj_patt = NULL, *obj_size = NULL;
+	const uint16_t *bank_map = NULL;        // SDRAM address >> 10 of each 1KB of $0000-$1FFF
+};
@@ -0,0 +1,219 @@
+#!/usr/bin/python3
+
+# Where the model's eval time goes, using the profiling build of the headless
+# simulator (make PROFILE=1 headless, or make profile).
+#
+# That build is verilated with --prof-cfuncs, which tags every generated function
+# with the Verilog source line it came from (__PROF__<file>__l<line>, the file
+# name without directory and extension), and compiled with -pg. Each ROM is
+# simulated for a number of frames, and the gprof flat profile is attributed to
+# source files under src/, then to blocks (the CPU, PPU, APU, cart mappers, the
+# SDRAM model ...) by the files' paths. Time that belongs to no source line is
+# reported as the Verilated runtime or the harness. A ranked table is printed
+# per ROM.
+#
+#   profile_report.py game.nes                   300 frames of game.nes
+#   profile_report.py -f 600 a.nes b.nes         several ROMs, a table each
+#   profile_report.py --json prof.json a.nes     also write the results as JSON
+#   profile_report.py --baseline prof.json a.nes compare with an earlier run
+#
+# With --baseline, every block's time per frame is compared with the same ROM in
+# the earlier JSON, and the exit status is 1 if a block became slower by more than
+# --max-regress percent. Runs on the same machine are comparable across commits.
+
+import argparse
+import glob
+import json
+import os
+import re
+import shutil
+import subprocess
+import sys
+import tempfile
+
+from simtools import DIR, add_sim_args, check_sim, run_sim, write_json
+
+SRC = os.path.join(DIR, '..', 'src')
+
+# block of a source file, by path relative to src/. Other files are a block of
+# their own, named after the file.
+BLOCKS = [
+    ('t65/', 'cpu'),
+    ('mappers/', 'cart'),
+    ('cart.sv', 'cart'),
+    ('hdmi2/', 'hdmi'),
+    ('nes2hdmi.sv', 'hdmi'),
+    ('verilator/sdram_sim.v', 'sdram'),
+    ('nestang_top.sv', 'top'),
+]
+RUNTIME = '(verilated runtime)'
+UNATTRIBUTED = '(model, no source line)'
+HARNESS = '(harness)'
+
+
+# --prof-cfuncs tag -> path relative to src/: the tag is the file name without
+# directory and extension, with characters other than [A-Za-z0-9_] made _
+def source_files():
+    files = {}
+    paths = sorted(glob.glob(os.path.join(SRC, '**', '*.v'), recursive=True) +
+                   glob.glob(os.path.join(SRC, '**', '*.sv'), recursive=True))
+    # the simulation models in src/verilator replace the hardware ones of the same name
+    paths.sort(key=lambda f: os.path.relpath(f, SRC).startswith('verilator/'))
+    for fname in paths:
+        rel = os.path.relpath(fname, SRC).replace(os.sep, '/')
+        tag = re.sub(r'\W', '_', os.path.splitext(os.path.basename(rel))[0])
+        files[tag] = rel
+    return files
+
+
+def block_of(rel):
+    return next((b for prefix, b in BLOCKS if rel.startswith(prefix)),
+                os.path.splitext(os.path.basename(rel))[0])
+
+
+# --prof-cfuncs names functions ..__PROF__<file>__l<line>
+PROF_RE = re.compile(r'__PROF__(\w+?)__l\d+')
+FLAT_RE = re.compile(r'^\s*([\d.]+)\s+([\d.]+)\s+([\d.]+)\s+(?:\d+\s+[\d.]+\s+[\d.]+\s+)?(\S.*)$')
+
+
+# source file (relative to src/) or one of the catch-alls above
+def attribute(func, top, files):
+    m = PROF_RE.search(func)
+    if m:
+        return files.get(m.group(1), m.group(1))
+    if func.startswith(('Verilated', 'VL_', 'vl_', 'Vl')):
+        return RUNTIME
+    if func.startswith(top):
+        return UNATTRIBUTED
+    return HARNESS
+
+
+# gprof flat profile -> [(function, self seconds)]
+def flat_profile(sim, gmon):
+    p = subprocess.run(['gprof', '-b', '-p', '--demangle', sim, gmon], stdout=subprocess.PIPE,
+                       stderr=subprocess.STDOUT, universal_newlines=True)
+    if p.returncode != 0:
+        return None, 'gprof failed:\n' + p.stdout[-2000:]
+    funcs = []
+    for line in p.stdout.splitlines():
+        m = FLAT_RE.match(line)
+        if m:
+            funcs.append((m.group(4).strip(), float(m.group(3))))
+    if not funcs:
+        return None, 'empty profile, is %s a PROFILE=1 build?' % sim
+    return funcs, None
+
+
+def run_rom(args, rom, tmp):
+    prefix = os.path.join(tmp, 'gmon')
+    for f in glob.glob(prefix + '.*'):
+        os.remove(f)
+    # glibc writes the profile to GMON_OUT_PREFIX.<pid> instead of ./gmon.out
+    env = dict(os.environ, GMON_OUT_PREFIX=prefix)
+    stats, _, err = run_sim(args, ['-n', '-f', str(args.frames)] + ([os.path.abspath(rom)] if rom else []), env)
+    if err:
+        return None, err
+    gmon = glob.glob(prefix + '.*')
+    if not gmon:
+        return None, 'no profile written, is %s a PROFILE=1 build?' % args.sim
+    funcs, err = flat_profile(args.sim, gmon[0])
+    if err:
+        return None, err
+
+    files = source_files()
+    top = os.path.basename(args.sim)
+    by_file = {}
+    for func, secs in funcs:
+        f = attribute(func, top, files)
+        by_file[f] = by_file.get(f, 0) + secs
+    known = set(files.values())
+    by_block = {}
+    for f, secs in by_file.items():
+        b = block_of(f) if f in known else f
+        by_block[b] = by_block.get(b, 0) + secs
+    frames = stats['frames'] or 1
+    return {'rom': rom or '(built in)', 'frames': stats['frames'],
+            'wall_s': stats['wall_s'], 'cycles_per_sec': stats['cycles_per_sec'],
+            'profiled_s': sum(by_file.values()),
+            'blocks': {b: s / frames for b, s in by_block.items()},
+            'files': {f: s / frames for f, s in by_file.items()}}, None
+
+
+def print_table(title, costs, total, base=None, limit=None):
+    print('  %-28s %8s %12s%s' % (title, '%', 'ms/frame', '      vs base' if base is not None else ''))
+    ranked = sorted(((n, s) for n, s in costs.items() if s > 0), key=lambda kv: -kv[1])
+    for name, s in ranked[:limit]:
+        line = '  %-28s %7.1f%% %12.3f' % (name, s * 100 / total if total else 0, s * 1000)
+        if base is not None:
+            b = base.get(name)
+            line += '    %+8.1f%%' % ((s - b) * 100 / b) if b else '         new'
+        print(line)
+    if limit and len(ranked) > limit:
+        print('  ... %d more' % (len(ranked) - limit))
+
+
+# blocks whose time per frame grew by more than max_regress percent, ignoring
+# changes under the profile's resolution
+def regressions(r, base, max_regress):
+    out = []
+    resolution = 0.02 / max(r['frames'], 1)         # two gprof samples
+    for b, s in r['blocks'].items():
+        old = base['blocks'].get(b, 0)
+        if s - old > resolution and (not old or (s - old) * 100 / old > max_regress):
+            out.append('%s %+.1f%%' % (b, (s - old) * 100 / old) if old else '%s new' % b)
+    return out
+
+
+def main():
+    ap = argparse.ArgumentParser(description='Attribute the model\'s eval time to Verilog source files')
+    ap.add_argument('roms', nargs='*', help='ROMs to run (default the one compiled into the model)')
+    ap.add_argument('-f', '--frames', type=int, default=300, help='frames per ROM (default 300)')
+    ap.add_argument('-n', '--files', type=int, default=20, help='source files to list (default 20)')
+    add_sim_args(ap, 'obj_headless_prof')
+    ap.add_argument('--baseline', help='compare with the results of an earlier --json')
+    ap.add_argument('--max-regress', type=float, default=10, help='percent a block may slow down (default 10)')
+    args = ap.parse_args()
+
+    check_sim(args, 'make PROFILE=1 headless')
+    if not shutil.which('gprof'):
+        sys.exit('gprof not found')
+    baseline = {}
+    if args.baseline:
+        with open(args.baseline) as f:
+            baseline = {r['rom']: r for r in json.load(f)}
+
+    results = []
+    failed = 0
+    tmp = tempfile.mkdtemp(prefix='nestang_prof_')
+    try:
+        for rom in args.roms or [None]:
+            r, err = run_rom(args, rom, tmp)
+            if err:
+                failed += 1
+                print('%s: FAIL %s' % (rom or '(built in)', err), flush=True)
+                continue
+            base = baseline.get(r['rom'])
+            total = sum(r['blocks'].values())
+            print('%s: %d frames, %.0f cycles/sec, %.2fs profiled%s' % (
+                r['rom'], r['frames'], r['cycles_per_sec'], r['profiled_s'],
+                '' if base else ' (not in baseline)' if args.baseline else ''))
+            print_table('block', r['blocks'], total, base and base['blocks'])
+            print()
+            print_table('file', r['files'], total, base and base.get('files'), args.files)
+            if base:
+                slower = regressions(r, base, args.max_regress)
+                if slower:
+                    failed += 1
+                    print('  SLOWER than baseline: ' + ', '.join(slower))
+            print(flush=True)
+            results.append(r)
+    finally:
+        shutil.rmtree(tmp, ignore_errors=True)
+
+    if args.json:
+        write_json(args.json, results)
+    sys.exit(1 if failed else 0)
+
+
+if __name__ == '__main__':
+    main()
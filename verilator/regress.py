@@ -0,0 +1,199 @@
+#!/usr/bin/python3
+
+# Golden-frame regression over a ROM corpus, using the headless simulator.
+#
+# Each ROM in the manifest is simulated for a number of frames. Frame hashes are
+# compared with the golden hashes in golden/<name>.txt. Mismatching frames are
+# written out, and when a golden image of the frame exists, a diff image is made
+# (differing pixels in red over the dimmed expected frame). ROMs run in parallel,
+# one simulator process per core.
+#
+#   regress.py                  check everything in regress.txt
+#   regress.py nes15 smb        check only these entries
+#   regress.py --update         regenerate golden hashes and images
+#   regress.py --cpu-check      also check the CPU against the 6502 reference model
+#
+# Manifest lines: <name> <rom> <frames> [hash=LIST] [images=LIST] [movie=FILE]
+#   rom and movie are relative to the manifest. LIST is like 1,60,100-110 or all.
+#   hash selects the frames kept in the golden file (default all),
+#   images the frames whose golden image is stored for diffing (default the last).
+
+import argparse
+import os
+import shutil
+import sys
+import time
+from concurrent.futures import ThreadPoolExecutor
+
+from simtools import DIR, add_sim_args, check_sim, manifest_lines, manifest_path, run_sim, select_entries
+
+W, H = 256, 240
+
+
+class Entry:
+    def __init__(self, name, rom, frames, hash_list='all', images=None):
+        self.name = name
+        self.rom = rom
+        self.frames = frames
+        self.hash_list = hash_list
+        self.images = images or str(frames)
+        self.movie = None
+
+
+def parse_manifest(fname):
+    entries = []
+    for lineno, line in manifest_lines(fname):
+        if len(line) < 3 or not line[2].isdigit():
+            sys.exit('%s:%d: expecting <name> <rom> <frames> [hash=LIST] [images=LIST] [movie=FILE]' % (fname, lineno))
+        e = Entry(line[0], line[1], int(line[2]))
+        for opt in line[3:]:
+            k, _, v = opt.partition('=')
+            if k == 'hash':
+                e.hash_list = v
+            elif k == 'images':
+                e.images = v
+            elif k == 'movie':
+                e.movie = manifest_path(fname, v)
+            else:
+                sys.exit('%s:%d: unknown option %s' % (fname, lineno, opt))
+        entries.append(e)
+    return entries
+
+
+# 'all' or '1,60,100-110' -> predicate on frame number
+def frame_filter(s):
+    if s == 'all':
+        return lambda n: True
+    ranges = []
+    for part in s.split(','):
+        a, _, b = part.partition('-')
+        ranges.append((int(a), int(b or a)))
+    return lambda n: any(a <= n <= b for a, b in ranges)
+
+
+def read_ppm(fname):
+    with open(fname, 'rb') as f:
+        data = f.read()
+    # header written by write_ppm(): "P6\n256 240\n255\n"
+    fields = data.split(b'\n', 3)
+    if fields[0] != b'P6' or fields[1] != b'%d %d' % (W, H):
+        raise ValueError('%s: unexpected PPM header' % fname)
+    return fields[3]
+
+
+def write_diff(expected, actual, fname):
+    out = bytearray(len(expected))
+    ndiff = 0
+    for i in range(0, len(expected), 3):
+        if expected[i:i+3] != actual[i:i+3]:
+            out[i] = 255
+            ndiff += 1
+        else:
+            out[i] = expected[i] // 4
+            out[i+1] = expected[i+1] // 4
+            out[i+2] = expected[i+2] // 4
+    with open(fname, 'wb') as f:
+        f.write(b'P6\n%d %d\n255\n' % (W, H))
+        f.write(out)
+    return ndiff
+
+
+def run_rom(args, e, extra):
+    options = ['-f', str(e.frames)] + extra
+    if e.movie:
+        options += ['-m', e.movie]
+    if args.cpu_check:
+        options.append('-K')
+    stats, out, err = run_sim(args, options + [e.rom])
+    if err:
+        return None, err
+    if stats.get('cpu_errors'):
+        report = [l for l in out.splitlines() if not l.startswith('{')]
+        return None, 'CPU check failed:\n' + '\n'.join(report)[-4000:]
+    return stats, None
+
+
+def update(args, e):
+    gdir = os.path.join(args.golden, e.name)
+    shutil.rmtree(gdir, ignore_errors=True)
+    os.makedirs(gdir)
+    all_hashes = os.path.join(gdir, 'all_hashes.txt')
+    stats, err = run_rom(args, e, ['-g', all_hashes, '-w', e.images, '-o', gdir])
+    if err:
+        return False, err
+    keep = frame_filter(e.hash_list)
+    with open(all_hashes) as f, open(os.path.join(args.golden, e.name + '.txt'), 'w') as out:
+        out.write('# %s, %d frames\n' % (os.path.relpath(e.rom, DIR), e.frames))
+        for line in f:
+            if keep(int(line.split()[0])):
+                out.write(line)
+    os.remove(all_hashes)
+    if stats['frames'] < e.frames:
+        return False, 'only %d of %d frames' % (stats['frames'], e.frames)
+    return True, 'updated, %d images' % stats['frames_written']
+
+
+def check(args, e):
+    golden = os.path.join(args.golden, e.name + '.txt')
+    if not os.path.exists(golden):
+        return False, 'no golden file, run with --update'
+    with open(golden) as f:
+        expected = sum(1 for l in f if l.strip() and not l.startswith('#'))
+    odir = os.path.join(args.out, e.name)
+    shutil.rmtree(odir, ignore_errors=True)
+    os.makedirs(odir)
+    stats, err = run_rom(args, e, ['-G', golden, '-o', odir])
+    if err:
+        return False, err
+    if stats['golden_mismatches'] == 0:
+        if stats['golden_checked'] != expected:
+            return False, 'only %d of %d golden frames reached' % (stats['golden_checked'], expected)
+        os.rmdir(odir)
+        return True, '%d frames ok (%.1fs)' % (expected, stats['wall_s'])
+
+    mismatches = sorted(f for f in os.listdir(odir) if f.startswith('mismatch_'))
+    msg = '%d of %d frames differ, first is %s' % (stats['golden_mismatches'], expected,
+                                                   mismatches[0][9:14] if mismatches else '?')
+    for m in mismatches:
+        ref = os.path.join(args.golden, e.name, 'frame_' + m[9:])
+        if os.path.exists(ref):
+            n = write_diff(read_ppm(ref), read_ppm(os.path.join(odir, m)),
+                           os.path.join(odir, 'diff_' + m[9:]))
+            msg += '\n    frame %s: %d pixels differ, see %s' % (m[9:14], n, os.path.join(odir, 'diff_' + m[9:]))
+    return False, msg
+
+
+def main():
+    ap = argparse.ArgumentParser(description='Golden-frame regression over a ROM corpus')
+    ap.add_argument('names', nargs='*', help='manifest entries to run (default all)')
+    ap.add_argument('--update', action='store_true', help='regenerate golden hashes and images')
+    ap.add_argument('-j', '--jobs', type=int, default=os.cpu_count(), help='parallel simulations')
+    ap.add_argument('--manifest', default=os.path.join(DIR, 'regress.txt'))
+    ap.add_argument('--golden', default=os.path.join(DIR, 'golden'))
+    ap.add_argument('--out', default=os.path.join(DIR, 'regress_out'), help='mismatches and diffs go here')
+    add_sim_args(ap, json_out=False)
+    ap.add_argument('--cpu-check', action='store_true', help='run with -K, fail on CPU divergence')
+    args = ap.parse_args()
+    args.golden = os.path.abspath(args.golden)
+    args.out = os.path.abspath(args.out)
+
+    check_sim(args)
+    entries = select_entries(parse_manifest(args.manifest), args.names)
+    os.makedirs(args.golden, exist_ok=True)
+
+    job = update if args.update else check
+    start = time.time()
+    failed = 0
+    with ThreadPoolExecutor(max_workers=max(1, args.jobs)) as pool:
+        futures = [(e, pool.submit(job, args, e)) for e in entries]
+        for e, fut in futures:
+            ok, msg = fut.result()
+            failed += not ok
+            print('%-4s %-20s %s' % ('ok' if ok else 'FAIL', e.name, msg), flush=True)
+
+    print('\n%d of %d passed in %.0fs' % (len(entries) - failed, len(entries), time.time() - start))
+    sys.exit(1 if failed else 0)
+
+
+if __name__ == '__main__':
+    main()
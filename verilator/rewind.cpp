@@ -0,0 +1,108 @@
+// Rewind buffer, see rewind.h
+
+#include "rewind.h"
+
+using namespace std;
+
+// Changed runs closer than this are merged, a run header costs 8 bytes
+static const size_t MIN_GAP = 16;
+
+static void put32(vector<uint8_t> &d, uint32_t v) {
+	d.insert(d.end(), (uint8_t *)&v, (uint8_t *)&v + 4);
+}
+
+static uint32_t get32(const uint8_t *p) {
+	uint32_t v;
+	memcpy(&v, p, 4);
+	return v;
+}
+
+static bool same8(const uint8_t *a, const uint8_t *b) {
+	uint64_t x, y;
+	memcpy(&x, a, 8);
+	memcpy(&y, b, 8);
+	return x == y;
+}
+
+// Delta that turns `from` into `to`: the size of `to`, then runs of
+// <bytes to skip> <length> <bytes>
+static void make_delta(const vector<uint8_t> &from, const vector<uint8_t> &to, vector<uint8_t> &d) {
+	d.clear();
+	put32(d, to.size());
+	size_t n = min(from.size(), to.size()) & ~(size_t)7;
+	const uint8_t *a = from.data(), *b = to.data();
+	size_t pos = 0, i = 0;          // pos: end of the last run
+	while (i < n) {
+		if (same8(a + i, b + i)) {
+			i += 8;
+			continue;
+		}
+		size_t start = i, same = 0;
+		for (i += 8; i < n && same < MIN_GAP; i += 8)
+			same = same8(a + i, b + i) ? same + 8 : 0;
+		size_t stop = i - same;
+		put32(d, start - pos);
+		put32(d, stop - start);
+		d.insert(d.end(), b + start, b + stop);
+		pos = stop;
+	}
+	// the tail that was not compared
+	if (to.size() > n) {
+		put32(d, n - pos);
+		put32(d, to.size() - n);
+		d.insert(d.end(), b + n, b + to.size());
+	}
+}
+
+static void apply_delta(vector<uint8_t> &s, const vector<uint8_t> &d) {
+	const uint8_t *p = d.data(), *end = p + d.size();
+	s.resize(get32(p));
+	p += 4;
+	size_t pos = 0;
+	while (p < end) {
+		pos += get32(p);
+		uint32_t len = get32(p + 4);
+		memcpy(&s[pos], p + 8, len);
+		pos += len;
+		p += 8 + len;
+	}
+}
+
+void RewindBuffer::commit(uint64_t sim_time, int frame) {
+	if (!snaps.empty()) {
+		Snap &prev = snaps.back();
+		make_delta(spare, newest, prev.delta);
+		prev.delta.shrink_to_fit();         // the budget counts sizes
+		delta_bytes += prev.delta.size();
+	}
+	newest.swap(spare);
+	snaps.push_back(Snap{sim_time, frame, {}});
+	captures++;
+	trim();
+}
+
+bool RewindBuffer::rewind(size_t n, vector<uint8_t> &out) {
+	if (n == 0 || n > snaps.size())
+		return false;
+	while (--n) {
+		snaps.pop_back();
+		Snap &s = snaps.back();
+		apply_delta(newest, s.delta);
+		delta_bytes -= s.delta.size();
+		vector<uint8_t>().swap(s.delta);
+	}
+	out = newest;
+	return true;
+}
+
+void RewindBuffer::trim() {
+	while (snaps.size() > 1 && bytes() > budget) {
+		delta_bytes -= snaps.front().delta.size();
+		snaps.pop_front();
+	}
+	if (budget == 0) {
+		snaps.clear();
+		vector<uint8_t>().swap(newest);
+		delta_bytes = 0;
+	}
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+// Rewind buffer for the simulator prompt (rewind command, -R budget).
+//
+// The harness captures its whole state once per frame, in the checkpoint format
+// but in memory. Only the newest snapshot is kept in full. Each older one is kept
+// as a delta that turns the snapshot after it back into it, so a capture costs a
+// serialization plus one compare against the previous state, and frames where
+// little changes cost little memory. Going back n frames applies n deltas to the
+// newest state. When the buffer goes over its memory budget, the oldest snapshots
+// are dropped.
+//
+// Deltas are runs of changed bytes between unchanged stretches, found comparing
+// 8 bytes at a time.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <vector>
+
+#ifdef SIM_SAVABLE
+#include <verilated_save.h>
+
+// VerilatedSave/VerilatedRestore to and from memory
+class MemSave : public VerilatedSerialize {
+public:
+	explicit MemSave(std::vector<uint8_t> &out) : out(out) { m_isOpen = true; }
+	~MemSave() override { close(); }
+	void flush() override {
+		out.insert(out.end(), m_bufp, m_cp);
+		m_cp = m_bufp;
+	}
+	void close() override {
+		if (m_isOpen)
+			flush();
+		m_isOpen = false;
+	}
+private:
+	std::vector<uint8_t> &out;
+};
+
+class MemRestore : public VerilatedDeserialize {
+public:
+	MemRestore(const uint8_t *data, size_t n) : p(data), end(data + n) {
+		m_isOpen = true;
+		m_endp = m_bufp;
+	}
+protected:
+	void fill() override {
+		size_t keep = m_endp - m_cp;
+		memmove(m_bufp, m_cp, keep);
+		m_cp = m_bufp;
+		m_endp = m_bufp + keep;
+		size_t n = std::min((size_t)(end - p), bufferSize() - keep);
+		memcpy(m_endp, p, n);
+		m_endp += n;
+		p += n;
+	}
+private:
+	const uint8_t *p, *end;
+};
+#endif
+
+class RewindBuffer {
+public:
+	void set_budget(size_t bytes) { budget = bytes; trim(); }
+	bool enabled() const { return budget > 0; }
+	void clear() { snaps.clear(); newest.clear(); delta_bytes = 0; }
+
+	// Capture: serialize into the buffer from next(), then commit() it
+	std::vector<uint8_t> &next() { spare.clear(); return spare; }
+	void commit(uint64_t sim_time, int frame);
+
+	// Go back to the n-th newest snapshot (1 is the newest) and put its state in
+	// out. Newer snapshots are dropped. Returns false if there are not n.
+	bool rewind(size_t n, std::vector<uint8_t> &out);
+
+	size_t count() const { return snaps.size(); }
+	uint64_t newest_time() const { return snaps.empty() ? ~0ULL : snaps.back().sim_time; }
+	int oldest_frame() const { return snaps.empty() ? 0 : snaps.front().frame; }
+	int newest_frame() const { return snaps.empty() ? 0 : snaps.back().frame; }
+	size_t bytes() const { return newest.size() + delta_bytes; }
+	uint64_t captures = 0;
+	uint64_t capture_ns = 0;                // time spent capturing, measured by the harness
+
+private:
+	struct Snap {
+		uint64_t sim_time;
+		int frame;
+		std::vector<uint8_t> delta;         // turns the next newer state into this one
+	};
+	void trim();
+
+	size_t budget = 0;
+	std::deque<Snap> snaps;                 // oldest first, the newest has no delta
+	std::vector<uint8_t> newest, spare;
+	size_t delta_bytes = 0;
+};
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+// Lock-free single-producer single-consumer ring. N must be a power of 2.
+// Used to move data off the sim thread without ever blocking it.
+template <typename T, size_t N>
+class SpscRing {
+	static_assert((N & (N - 1)) == 0, "SpscRing size must be a power of 2");
+public:
+	// producer side. Returns false (and drops v) if the ring is full.
+	bool push(const T &v) {
+		size_t h = head.load(std::memory_order_relaxed);
+		if (h - tail.load(std::memory_order_acquire) == N)
+			return false;
+		buf[h & (N-1)] = v;
+		head.store(h + 1, std::memory_order_release);
+		return true;
+	}
+
+	// producer side: slot to fill in place, NULL if full. Commit with push_commit().
+	T *push_slot() {
+		size_t h = head.load(std::memory_order_relaxed);
+		if (h - tail.load(std::memory_order_acquire) == N)
+			return NULL;
+		return &buf[h & (N-1)];
+	}
+	void push_commit() {
+		head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	}
+
+	// consumer side. Returns false if the ring is empty.
+	bool pop(T &v) {
+		T *p = front();
+		if (!p)
+			return false;
+		v = *p;
+		pop_commit();
+		return true;
+	}
+
+	// consumer side: oldest element in place, NULL if empty. Release with pop_commit().
+	T *front() {
+		size_t t = tail.load(std::memory_order_relaxed);
+		if (head.load(std::memory_order_acquire) == t)
+			return NULL;
+		return &buf[t & (N-1)];
+	}
+	void pop_commit() {
+		tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	}
+
+	size_t size() const {
+		return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+	}
+
+private:
+	T buf[N];
+	alignas(64) std::atomic<size_t> head{0};
+	alignas(64) std::atomic<size_t> tail{0};
+};
@@ -0,0 +1,105 @@
+// Simulated SDRAM contents and the DPI-C calls of src/verilator/sdram_sim.v, see sdram.h
+
+#include <cstdlib>
+
+#include "sdram.h"
+#include "Vnestang_top__Dpi.h"
+
+using namespace std;
+
+SparseMem sdram_cpu(4*1024*1024);
+SparseMem sdram_rv(2*1024*1024);
+
+// banks the DPI calls of this thread go to
+static thread_local SparseMem *dpi_cpu = &sdram_cpu;
+static thread_local SparseMem *dpi_rv = &sdram_rv;
+
+void sdram_bind(SparseMem *cpu, SparseMem *rv) {
+	dpi_cpu = cpu;
+	dpi_rv = rv;
+}
+
+SparseMem::SparseMem(uint32_t size)
+	: mask(size - 1), rpages(size >> PAGE_BITS), wpages(size >> PAGE_BITS), mapped(size >> PAGE_BITS) {}
+
+SparseMem::~SparseMem() {
+	clear();
+}
+
+uint8_t *SparseMem::own(uint32_t page) {
+	uint8_t *p = (uint8_t *)calloc(1, PAGE_SIZE);
+	if (rpages[page])
+		memcpy(p, rpages[page], PAGE_SIZE);
+	rpages[page] = wpages[page] = p;
+	return p;
+}
+
+// drop our copy, back to the image page or unused
+void SparseMem::release(uint32_t page) {
+	free(wpages[page]);
+	wpages[page] = NULL;
+	rpages[page] = mapped[page];
+}
+
+void SparseMem::read(uint32_t addr, void *buf, size_t n) const {
+	uint8_t *b = (uint8_t *)buf;
+	for (size_t i = 0; i < n; i++)
+		b[i] = read8(addr + i);
+}
+
+void SparseMem::write(uint32_t addr, const void *buf, size_t n) {
+	const uint8_t *b = (const uint8_t *)buf;
+	for (size_t i = 0; i < n; i++)
+		write8(addr + i, b[i]);
+}
+
+vector<uint8_t> SparseMem::snapshot(uint32_t addr, size_t n) const {
+	vector<uint8_t> r(n);
+	read(addr, r.data(), n);
+	return r;
+}
+
+void SparseMem::map(uint32_t addr, shared_ptr<const uint8_t> image, size_t offset, size_t n) {
+	size_t whole = n & ~(size_t)(PAGE_SIZE-1);
+	for (size_t i = 0; i < whole; i += PAGE_SIZE) {
+		uint32_t page = ((addr + i) & mask) >> PAGE_BITS;
+		free(wpages[page]);
+		wpages[page] = NULL;
+		rpages[page] = mapped[page] = image.get() + offset + i;
+	}
+	write(addr + whole, image.get() + offset + whole, n - whole);
+	images.push_back(image);
+}
+
+void SparseMem::clear() {
+	for (size_t i = 0; i < rpages.size(); i++) {
+		free(wpages[i]);
+		rpages[i] = wpages[i] = NULL;
+		mapped[i] = NULL;
+	}
+	images.clear();
+}
+
+size_t SparseMem::pages_used() const {
+	size_t n = 0;
+	for (auto p : rpages)
+		n += p != NULL;
+	return n;
+}
+
+// DPI-C imports of sdram_nes. Addresses are already within the port widths.
+unsigned char sdram_cpu_read(int addr) {
+	return dpi_cpu->read8(addr);
+}
+
+void sdram_cpu_write(int addr, unsigned char data) {
+	dpi_cpu->write8(addr, data);
+}
+
+unsigned short sdram_rv_read(int addr) {
+	return dpi_rv->read16(addr);
+}
+
+void sdram_rv_write(int addr, unsigned short data) {
+	dpi_rv->write16(addr, data);
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+// Simulated SDRAM contents, behind the DPI-C calls in src/verilator/sdram_sim.v.
+//
+// Memory is kept in 4KB pages. A page is only allocated when it is first written,
+// reads of untouched memory return 0. Pages can also point into a read-only image,
+// e.g. a mmap-ed .nes file, and are copied on the first write. So loading a ROM
+// costs no copy, and checkpoints only hold the pages in use.
+//
+// The harness reads and writes the memory directly with read()/write(), which is
+// how ROMs are preloaded and how the prompt's mem/poke/memsave commands work.
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+// SDRAM regions besides PRG/CHR ROM (ines.h), see the memory map in src/cart.sv
+const uint32_t SDRAM_CHR_VRAM = 0x300000;
+const uint32_t SDRAM_CPU_RAM  = 0x380000;
+const uint32_t SDRAM_CART_RAM = 0x3c0000;
+
+class SparseMem {
+public:
+	static const int PAGE_BITS = 12;
+	static const uint32_t PAGE_SIZE = 1 << PAGE_BITS;
+
+	explicit SparseMem(uint32_t size);     // bytes, a power of two
+	~SparseMem();
+
+	uint32_t size() const { return mask + 1; }
+
+	uint8_t read8(uint32_t a) const {
+		a &= mask;
+		const uint8_t *p = rpages[a >> PAGE_BITS];
+		return p ? p[a & (PAGE_SIZE-1)] : 0;
+	}
+	void write8(uint32_t a, uint8_t v) {
+		a &= mask;
+		uint8_t *p = wpages[a >> PAGE_BITS];
+		if (!p)
+			p = own(a >> PAGE_BITS);
+		p[a & (PAGE_SIZE-1)] = v;
+	}
+	// 16-bit words, little endian, w is a word address
+	uint16_t read16(uint32_t w) const { return read8(w*2) | read8(w*2 + 1) << 8; }
+	void write16(uint32_t w, uint16_t v) { write8(w*2, v); write8(w*2 + 1, v >> 8); }
+
+	// host-side access to a region, wraps around at the end like the ports do
+	void read(uint32_t addr, void *buf, size_t n) const;
+	void write(uint32_t addr, const void *buf, size_t n);
+	std::vector<uint8_t> snapshot(uint32_t addr, size_t n) const;
+
+	// Back [addr, addr+n) with image+offset without copying. addr must be page
+	// aligned. A partial last page is copied. The image is kept alive until clear().
+	void map(uint32_t addr, std::shared_ptr<const uint8_t> image, size_t offset, size_t n);
+
+	void clear();
+	size_t pages_used() const;
+
+	// Checkpoint streams (VerilatedSave/VerilatedRestore). Only pages in use are saved,
+	// mapped pages included, so a checkpoint does not need the ROM file to restore.
+	template <class OS> void save(OS &os) const {
+		uint32_t n = pages_used();
+		os.write(&n, sizeof(n));
+		for (uint32_t i = 0; i < rpages.size(); i++)
+			if (rpages[i]) {
+				os.write(&i, sizeof(i));
+				os.write(rpages[i], PAGE_SIZE);
+			}
+	}
+	template <class OS> void restore(OS &os) {
+		clear();
+		uint32_t n, i;
+		os.read(&n, sizeof(n));
+		while (n--) {
+			os.read(&i, sizeof(i));
+			os.read(own(i % rpages.size()), PAGE_SIZE);
+		}
+	}
+
+	// Rewind snapshots: only the pages written to, mapped pages stay shared with
+	// their image. A snapshot restores into the mapping it was saved with.
+	template <class OS> void save_written(OS &os) const {
+		uint32_t n = 0;
+		for (auto p : wpages)
+			n += p != NULL;
+		os.write(&n, sizeof(n));
+		for (uint32_t i = 0; i < wpages.size(); i++)
+			if (wpages[i]) {
+				os.write(&i, sizeof(i));
+				os.write(wpages[i], PAGE_SIZE);
+			}
+	}
+	template <class OS> void restore_written(OS &os) {
+		std::vector<bool> saved(wpages.size());
+		uint32_t n, i;
+		os.read(&n, sizeof(n));
+		while (n--) {
+			os.read(&i, sizeof(i));
+			i %= wpages.size();
+			saved[i] = true;
+			os.read(wpages[i] ? wpages[i] : own(i), PAGE_SIZE);
+		}
+		for (i = 0; i < wpages.size(); i++)
+			if (wpages[i] && !saved[i])
+				release(i);
+	}
+
+private:
+	uint8_t *own(uint32_t page);
+	void release(uint32_t page);
+
+	uint32_t mask;
+	std::vector<const uint8_t *> rpages;   // page contents, NULL for never written
+	std::vector<uint8_t *> wpages;         // same page if it is ours to write, else NULL
+	std::vector<const uint8_t *> mapped;   // image page from map(), kept after a write
+	std::vector<std::shared_ptr<const uint8_t>> images;
+};
+
+extern SparseMem sdram_cpu;                // 4MB, bank 0/1: NES PRG/CHR/RAM
+extern SparseMem sdram_rv;                 // 2MB, bank 2: RISC-V memory, 16-bit words
+
+// Make the DPI calls made on this thread use cpu/rv instead of the two above.
+// For several models in one process (sim_main -M, see multi.h): bind before
+// evaluating a model. Only works with the single-threaded model, which makes
+// its DPI calls on the thread that calls eval().
+void sdram_bind(SparseMem *cpu, SparseMem *rv);
@@ -1,45 +1,181 @@
 #include <cstdio>
 #include <iostream>
-#include <SDL.h>
 #include <cstdlib>
 #include <climits>
 #include <cstring>
 #include <vector>
 #include <cctype>
+#include <chrono>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <map>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/stat.h>
 
 #include "Vnestang_top.h"
 #include "Vnestang_top_nestang_top.h"
 #include "Vnestang_top_NES.h"
+#include "Vnestang_top_GameData.h"
 #include "verilated.h"
+#include "verilated_syms.h"
 #include <verilated_fst_c.h>
-#include "nes_palette.h"
+#ifdef SIM_SAVABLE
+#include <verilated_save.h>
+#endif
+#include "video.h"
+#include "display.h"
+#include "ines.h"
+#include "audio.h"
+#include "trigger.h"
+#include "movie.h"
+#include "telemetry.h"
+#include "breakpoints.h"
+#include "console.h"
+#include "sdram.h"
+#include "cputrace.h"
+#include "cpucheck.h"
+#include "tmds.h"
+#include "multi.h"
+#include "rewind.h"
+#include "ppuview.h"
+#include "busprof.h"
+#include "frameout.h"
 
 #define TRACE_ON
 
 using namespace std;
 
-// See: https://projectf.io/posts/verilog-sim-verilator-sdl/
-const int H_RES = 256;
-const int V_RES = 240;
-
-typedef struct Pixel {  // for SDL texture
-    uint8_t a;  // transparency
-    uint8_t b;  // blue
-    uint8_t g;  // green
-    uint8_t r;  // red
-} Pixel;
-
-Pixel screenbuffer[H_RES*V_RES];
+FrameOutput frame_out;						// PPU dots, -w/-o/-g/-G/-m, see frameout.h
 
 bool trace = false;
 long long max_sim_time = 10000000LL;		// 10 million clock cycles
 long long start_trace_time = 0;
+TraceTrigger *trigger = NULL;				// -T: triggered tracing
+
+// headless batch mode
+#ifdef NO_SDL
+bool headless = true;
+#else
+bool headless = false;
+#endif
+long long max_frames = 0;					// 0 means no frame limit
+const char *rom_path = NULL;				// game loaded at startup, NULL means the compiled-in one
+bool same_model = false;					// -n: do not switch to a mapper-specific model
+const char *restore_path = NULL;			// checkpoint to restore at startup
+const char *save_path = NULL;				// checkpoint to save when the run ends
+const char *wav_path = NULL;				// audio output file
+bool live_audio = false;					// play audio through SDL
+bool audio_on = false;
+int apu_div = 0;							// master clocks since the last audio sample
+
+// run-until engine: breakpoints and command input for the prompt
+Breakpoints breaks;
+Console console;
+const char *socket_path = NULL;				// -U: also take commands from this Unix socket
+
+// rewind buffer for the prompt, see rewind.h
+RewindBuffer rewind_buf;
+long long rewind_mb = 64;					// -R: memory budget, 0 turns it off
+bool rewind_due = false;					// capture a snapshot at the end of this clock
+
+// per-instruction CPU trace (-C), see cputrace.h
+CpuTrace cpu_trace;
+const char *cpu_trace_path = NULL;
+long long cpu_trace_from = 0;				// first frame to trace
+CpuChecker cpu_check;						// -K: lockstep 6502 checker, see cpucheck.h
+bool cpu_check_on = false;
+
+#ifdef SIM_HDMI
+// HDMI build (make HDMI=1): the pixel clock and the TMDS decoder, see tmds.h
+TmdsDecoder tmds;
+const uint16_t *tmds_symbols = NULL;		// hdmi.tmds_internal, channels 0-2
+uint32_t hclk_phase = 0;
+vector<pair<long long,long long>> hdmi_dump;	// -V: decoded frames to write
+const char *hdmi_hash_path = NULL;			// -X
+const char *hdmi_wav_path = NULL;			// -W
+#endif
+
+// bus traffic profile (-B), see busprof.h
+BusProfile bus_prof;
+const char *bus_prof_path = NULL;
+
+// per-frame telemetry (-P), see telemetry.h
+Telemetry telemetry;
+const char *perf_path = NULL;
+struct {
+	chrono::steady_clock::time_point start;		// of the current frame
+	uint64_t ticks, eval_ticks;
+	vluint64_t sim_time;
+	uint64_t present_ns, pace_ns, io_ns;
+} perf;
+
+// fork server: warm up once, then run each job line in a copy-on-write child
+const char *fork_jobs = NULL;				// job file, - for stdin
+int fork_parallel = 0;						// max children at once, 0 means one per core
+int job_id = -1;							// >= 0 in a job child
+
+// -M: many independent instances in this process, see multi.h
+const char *multi_jobs = NULL;
+
+// harness state, saved in checkpoints along with the model and the frame_out dots
+int frame_count = 0;
+
+// PPU viewers (-d, -D, ppu command), see ppuview.h
+PpuViewer ppu_viewer;
+vector<pair<long long,long long>> ppu_dump;	// -d: frames to write viewer sheets for
+bool ppu_live = false;						// -D: viewer window
+
+// display, see display.h
+TripleBuffer frames;
+PpuViewBuffer ppu_frames;
+Pacing pacing = PACE_TURBO;
+int present_every = 1;
+atomic<bool> sim_done(false);				// sim thread finished
+atomic<bool> quit_requested(false);			// window closed
+atomic<bool> at_prompt(false);				// sim thread is waiting for a command
 
 void usage() {
-	printf("Usage: sim [-t] [-c T]\n");
+	printf("Usage: sim [-t] [-c T] [-H] [-f N] [-w LIST] [-o DIR] [-p MODE] [-a F] [-A] [-C F] [-K] [-b COND] [-U PATH] [game.nes]\n");
+	printf("  game.nes  ROM to preload into SDRAM (.nes, or .hex dump). Default is the one in game_data.v\n");
 	printf("  -t     output trace file waveform.fst\n");
 	printf("  -s T0  start tracing from time T0\n");
+	printf("  -T F   triggered tracing as configured in F, see trigger.h\n");
 	printf("  -c T   limit simulate lenght to T time steps. T=0 means infinite.\n");
+	printf("  -H     headless: no window, no prompt, print JSON stats and exit\n");
+	printf("  -f N   stop after N frames\n");
+	printf("  -w L   write frames in L to disk as PPM, e.g. 1,60,100-110 or all\n");
+	printf("  -o DIR directory for written frames (default .)\n");
+	printf("  -d L   write PPU viewer sheets for frames in L to -o DIR as ppu_NNNNN.png\n");
+	printf("  -D     show the PPU viewer window (nametables, patterns, palette, sprites)\n");
+	printf("  -l F   restore checkpoint F at startup. -c and -f then count from the checkpoint\n");
+	printf("  -S F   save checkpoint F when the run ends\n");
+	printf("  -p M   pacing: turbo (default, unthrottled), realtime (60.1 Hz), or N (show every Nth frame)\n");
+	printf("  -m F[@N] play input movie F (.fm2, or 2 bytes per frame), movie frame 0 at frame N\n");
+	printf("  -a F   write audio to F (48 kHz mono WAV)\n");
+	printf("  -A     play audio live (best with -p realtime)\n");
+	printf("  -n     stay on this model, do not switch to the mapper-specific one built for the ROM\n");
+	printf("  -F F   fork server: run to the -c/-f point, then run each line of F (- for stdin)\n");
+	printf("         as a job in a forked child. Lines take -c -f -w -o -g -G -a -m -b -C -K -S -t -T -s\n");
+	printf("  -M F   run each line of F as an independent NES instance in this process, on -j threads.\n");
+	printf("         Lines take -c -f -w -o -g -G -m and a ROM\n");
+	printf("  -j N   run at most N fork-server jobs or -M instances at once (default: number of cores)\n");
+	printf("  -P F   write per-frame performance counters to F (CSV, or JSON lines if F is *.json)\n");
+	printf("  -B P   profile CPU and PPU bus traffic: P_frames.csv during the run, P.csv and P.png at the end\n");
+	printf("  -g F   write a hash of every frame to F\n");
+	printf("  -G F   check frame hashes against golden file F, mismatching frames go to -o DIR\n");
+	printf("  -C F[@N] write a per-instruction CPU trace to F (.gz compressed), starting at frame N\n");
+	printf("  -K     check the CPU against a 6502 reference model, stop at the first divergence\n");
+	printf("  -b C   stop at breakpoint C, e.g. -b 'pc $C000' or -b 'write $2000-$2007'. See breakpoints.h\n");
+	printf("  -R MB  memory for the prompt's rewind command, one snapshot per frame (default 64, 0 = off)\n");
+	printf("  -U P   also take prompt commands from Unix socket P, e.g. socat - UNIX-CONNECT:P.\n");
+	printf("         With -H the simulator then waits for commands instead of exiting\n");
+#ifdef SIM_HDMI
+	printf("  -V L   write decoded 1280x720 HDMI frames in L to -o DIR as hdmi_NNNNN.ppm\n");
+	printf("  -X F   write a hash of every decoded HDMI frame to F\n");
+	printf("  -W F   write the decoded HDMI audio to F (48 kHz stereo WAV)\n");
+#endif
 }
 
 VerilatedFstC *m_trace;
@@ -48,32 +184,182 @@ Vnestang_top* top = new Vnestang_top;
 // split by spaces
 vector<string> tokenize(string s);
 long long parse_num(string s);
+bool parse_frame_list(string s, vector<pair<long long,long long>> &r);
+bool frame_selected(long long frame, const vector<pair<long long,long long>> &list);
+bool write_ppu_sheet(const char *fname);
+bool load_golden(const char *fname, map<long long,uint64_t> &golden);
+void preload_rom(Vnestang_top *top, SparseMem &mem, const NesRom &rom);
+void switch_model(char **argv, const char *variant);
+bool save_checkpoint(const char *fname);
+bool load_checkpoint(const char *fname);
 void trace_on();
 void trace_off();
+void trigger_on();
+void rewind_capture();
+bool rewind_frames(long long n);
+void apply_input();
+void perf_reset();
+void perf_frame();
+uint64_t trace_bytes();
+int sim_run(bool finish = true);
+int fork_server();
+int run_job(int id, vector<string> &args);
+void sim_finish();
+void pace_realtime();
 
 vluint64_t sim_time;
+chrono::steady_clock::time_point start_ticks;
+vluint64_t start_sim_time;
+int start_frame;
+int status = 0;
+
+// Options that configure one run. These are also what a fork-server job line takes.
+// Returns the index of the last argument consumed, or 0 if argv[i] is not a run option.
+int parse_run_option(int argc, char **argv, int i) {
+	char *eptr;
+	if (strcmp(argv[i], "-t") == 0) {
+		trace = true;
+		printf("Tracing ON\n");
+	} else if (strcmp(argv[i], "-c") == 0 && i+1 < argc) {
+		max_sim_time = strtoll(argv[++i], &eptr, 10);
+		if (max_sim_time == 0)
+			printf("Simulating forever.\n");
+		else
+			printf("Simulating %lld steps\n", max_sim_time);
+	} else if (strcmp(argv[i], "-T") == 0 && i+1 < argc) {
+		string err;
+		trigger = new TraceTrigger;
+		if (!trigger->load(argv[++i], err)) {
+			printf("%s\n", err.c_str());
+			exit(1);
+		}
+	} else if (strcmp(argv[i], "-s") == 0 && i+1 < argc) {
+		start_trace_time = strtoll(argv[++i], &eptr, 10);
+		printf("Start tracing from %lld\n", start_trace_time);
+	} else if (strcmp(argv[i], "-f") == 0 && i+1 < argc) {
+		max_frames = strtoll(argv[++i], &eptr, 10);
+	} else if (strcmp(argv[i], "-w") == 0 && i+1 < argc) {
+		if (!parse_frame_list(argv[++i], frame_out.dump_frames)) {
+			printf("Cannot parse frame list: %s\n", argv[i]);
+			exit(1);
+		}
+	} else if (strcmp(argv[i], "-o") == 0 && i+1 < argc) {
+		frame_out.out_dir = argv[++i];
+	} else if (strcmp(argv[i], "-d") == 0 && i+1 < argc) {
+		if (!parse_frame_list(argv[++i], ppu_dump)) {
+			printf("Cannot parse frame list: %s\n", argv[i]);
+			exit(1);
+		}
+	} else if (strcmp(argv[i], "-S") == 0 && i+1 < argc) {
+		save_path = argv[++i];
+	} else if (strcmp(argv[i], "-a") == 0 && i+1 < argc) {
+		wav_path = argv[++i];
+	} else if (strcmp(argv[i], "-P") == 0 && i+1 < argc) {
+		perf_path = argv[++i];
+	} else if (strcmp(argv[i], "-B") == 0 && i+1 < argc) {
+		bus_prof_path = argv[++i];
+	} else if (strcmp(argv[i], "-m") == 0 && i+1 < argc) {
+		string path = argv[++i], err;
+		size_t at = path.rfind('@');
+		InputMovie *movie = new InputMovie;
+		frame_out.movie.reset(movie);
+		if (at != string::npos) {
+			movie->start = atoll(path.c_str() + at + 1);
+			path.resize(at);
+		}
+		if (!movie->load(path.c_str(), err)) {
+			printf("Cannot load movie %s: %s\n", path.c_str(), err.c_str());
+			exit(1);
+		}
+		if (movie->resets)
+			printf("Movie %s: %d reset commands ignored\n", path.c_str(), movie->resets);
+	} else if (strcmp(argv[i], "-g") == 0 && i+1 < argc) {
+		frame_out.hash_file = fopen(argv[++i], "w");
+		if (!frame_out.hash_file) {
+			printf("Cannot open %s\n", argv[i]);
+			exit(1);
+		}
+	} else if (strcmp(argv[i], "-G") == 0 && i+1 < argc) {
+		if (!load_golden(argv[++i], frame_out.golden))
+			exit(1);
+	} else if (strcmp(argv[i], "-C") == 0 && i+1 < argc) {
+		cpu_trace_path = argv[++i];
+		const char *at = strrchr(cpu_trace_path, '@');
+		if (at) {
+			cpu_trace_from = atoll(at + 1);
+			cpu_trace_path = strndup(cpu_trace_path, at - cpu_trace_path);
+		}
+	} else if (strcmp(argv[i], "-K") == 0) {
+		cpu_check_on = true;
+	} else if (strcmp(argv[i], "-b") == 0 && i+1 < argc) {
+		Breakpoint b;
+		string err;
+		if (!Breakpoints::parse(tokenize(argv[++i]), 0, b, err)) {
+			printf("Bad breakpoint %s: %s\n", argv[i], err.c_str());
+			exit(1);
+		}
+		breaks.add(b);
+	} else
+		return 0;
+	return i;
+}
+
 int main(int argc, char** argv, char** env) {
 	Verilated::commandArgs(argc, argv);
-	Vnestang_top_NES *nes = top->nestang_top->nes;
-	bool frame_updated = false;
-	uint64_t start_ticks = SDL_GetPerformanceCounter();
-	int frame_count = 0;
 
 	// parse options
 	for (int i = 1; i < argc; i++) {
-		char *eptr;
-		if (strcmp(argv[i], "-t") == 0) {
-			trace = true;
-			printf("Tracing ON\n");
-		} else if (strcmp(argv[i], "-c") == 0 && i+1 < argc) {
-			max_sim_time = strtoll(argv[++i], &eptr, 10); 
-			if (max_sim_time == 0)
-				printf("Simulating forever.\n");
-			else
-				printf("Simulating %lld steps\n", max_sim_time);
-		} else if (strcmp(argv[i], "-s") == 0 && i+1 < argc) {
-			start_trace_time = strtoll(argv[++i], &eptr, 10);
-			printf("Start tracing from %lld\n", start_trace_time);
+		int next = parse_run_option(argc, argv, i);
+		if (next) {
+			i = next;
+			continue;
+		}
+		if (strcmp(argv[i], "-H") == 0) {
+			headless = true;
+		} else if (strcmp(argv[i], "-l") == 0 && i+1 < argc) {
+			restore_path = argv[++i];
+		} else if (strcmp(argv[i], "-p") == 0 && i+1 < argc) {
+			i++;
+			if (strcmp(argv[i], "turbo") == 0)
+				pacing = PACE_TURBO;
+			else if (strcmp(argv[i], "realtime") == 0)
+				pacing = PACE_REALTIME;
+			else if ((present_every = atoi(argv[i])) > 0)
+				pacing = PACE_EVERY_N;
+			else {
+				printf("Unknown pacing mode: %s\n", argv[i]);
+				exit(1);
+			}
+		} else if (strcmp(argv[i], "-A") == 0) {
+			live_audio = true;
+		} else if (strcmp(argv[i], "-n") == 0) {
+			same_model = true;
+		} else if (strcmp(argv[i], "-D") == 0) {
+			ppu_live = true;
+		} else if (strcmp(argv[i], "-F") == 0 && i+1 < argc) {
+			fork_jobs = argv[++i];
+			headless = true;
+		} else if (strcmp(argv[i], "-M") == 0 && i+1 < argc) {
+			multi_jobs = argv[++i];
+		} else if (strcmp(argv[i], "-j") == 0 && i+1 < argc) {
+			fork_parallel = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "-R") == 0 && i+1 < argc) {
+			rewind_mb = atoll(argv[++i]);
+		} else if (strcmp(argv[i], "-U") == 0 && i+1 < argc) {
+			socket_path = argv[++i];
+#ifdef SIM_HDMI
+		} else if (strcmp(argv[i], "-V") == 0 && i+1 < argc) {
+			if (!parse_frame_list(argv[++i], hdmi_dump)) {
+				printf("Cannot parse frame list: %s\n", argv[i]);
+				exit(1);
+			}
+		} else if (strcmp(argv[i], "-X") == 0 && i+1 < argc) {
+			hdmi_hash_path = argv[++i];
+		} else if (strcmp(argv[i], "-W") == 0 && i+1 < argc) {
+			hdmi_wav_path = argv[++i];
+#endif
+		} else if (argv[i][0] != '-' && !rom_path) {
+			rom_path = argv[i];
 		} else {
 			printf("Unrecognized option: %s\n", argv[i]);
 			usage();
@@ -81,136 +367,759 @@ int main(int argc, char** argv, char** env) {
 		}
 	}
 
-    if (SDL_Init(SDL_INIT_VIDEO) < 0) {
-        printf("SDL init failed.\n");
-        return 1;
-    }
-
-    SDL_Window*   sdl_window   = NULL;
-    SDL_Renderer* sdl_renderer = NULL;
-    SDL_Texture*  sdl_texture  = NULL;
-
-    sdl_window = SDL_CreateWindow("NESTang", SDL_WINDOWPOS_CENTERED,
-        SDL_WINDOWPOS_CENTERED, H_RES*2, V_RES*2, SDL_WINDOW_SHOWN);
-    if (!sdl_window) {
-        printf("Window creation failed: %s\n", SDL_GetError());
-        return 1;
-    }
-    sdl_renderer = SDL_CreateRenderer(sdl_window, -1,
-        SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
-    if (!sdl_renderer) {
-        printf("Renderer creation failed: %s\n", SDL_GetError());
-        return 1;
-    }
-
-    sdl_texture = SDL_CreateTexture(sdl_renderer, SDL_PIXELFORMAT_RGBA8888,
-        SDL_TEXTUREACCESS_TARGET, H_RES, V_RES);
-    if (!sdl_texture) {
-        printf("Texture creation failed: %s\n", SDL_GetError());
-        return 1;
-    }
+	if (multi_jobs) {
+		// instances bring their own models, the global one is not used
+		if (top->contextp()->threads() > 1) {
+			printf("-M needs the single-threaded model, DPI calls must run on the instance's thread\n");
+			exit(1);
+		}
+		if (rom_path || restore_path || fork_jobs || trace || trigger || wav_path || perf_path || bus_prof_path ||
+		    cpu_trace_path || cpu_check_on || frame_out.movie || frame_out.hash_file || !frame_out.golden.empty() ||
+		    !frame_out.dump_frames.empty() ||
+		    !ppu_dump.empty() || ppu_live) {
+			printf("With -M, ROMs and run options go on the job lines\n");
+			exit(1);
+		}
+		delete top;
+		return multi_run(multi_jobs, fork_parallel);
+	}
+
+	if (rom_path) {
+		NesRom rom;
+		string err;
+		if (!load_rom(rom_path, rom, err)) {
+			printf("Cannot load %s: %s\n", rom_path, err.c_str());
+			exit(1);
+		}
+		if (!model_has_mapper(rom.mapper)) {
+			printf("This model is built with MAPPERS=%s and does not have mapper %d\n", model_mappers, rom.mapper);
+			exit(1);
+		}
+		// a checkpoint only restores into the model that saved it
+		if (!same_model && !restore_path && strcmp(model_mappers, "all") == 0 && mapper_variant(rom.mapper))
+			switch_model(argv, mapper_variant(rom.mapper));
+		preload_rom(top, sdram_cpu, rom);
+		if (!headless)
+			printf("Loaded %s: mapper %d, PRG %zuKB, CHR %zuKB%s\n", rom_path, rom.mapper,
+			       rom.prg_size / 1024, rom.chr_size / 1024, rom.chr_size ? "" : " (CHR RAM)");
+	}
+
+	if (restore_path) {
+		if (!load_checkpoint(restore_path))
+			exit(1);
+		if (max_sim_time)
+			max_sim_time += sim_time;
+		if (max_frames)
+			max_frames += frame_count;
+	}
+	start_sim_time = sim_time;
+	start_frame = frame_count;
+	apply_input();
+
+	if (fork_jobs) {
+		if (trace || trigger || wav_path || perf_path || cpu_trace_path || bus_prof_path) {
+			printf("In fork-server mode, -t, -T, -a, -P, -C and -B go on job lines\n");
+			exit(1);
+		}
+#ifdef SIM_HDMI
+		if (!hdmi_dump.empty() || hdmi_hash_path || hdmi_wav_path) {
+			printf("-V, -X and -W are not supported in fork-server mode\n");
+			exit(1);
+		}
+#endif
+		start_ticks = chrono::steady_clock::now();
+		return fork_server();
+	}
 
 	if (trace)
 		trace_on();
+	if (trigger)
+		trigger_on();
 
-	bool done = false;
-	while (!done) {
-		while (max_sim_time == 0 || sim_time < max_sim_time) {
-			// top->sys_resetn = 1;
-			// if(sim_time > 1 && sim_time < 5){
-			// 	top->sys_resetn = 0;
-			// }
-			top->sys_clk ^= 1;
-			top->eval(); 
-			if (trace && sim_time >= start_trace_time)
-				m_trace->dump(sim_time);
-
-			if (nes->scanline >= 0 && nes->scanline < 240 && nes->cycle >= 0 && nes->cycle <= 256) {
-				Pixel* p = &screenbuffer[nes->scanline*H_RES + nes->cycle];
-				int color = nes->color;
-				p->a = 0xFF;  // transparency
-				p->r = (NES_PALETTE[color] >> 16) & 0xff;
-				p->g = (NES_PALETTE[color] >> 8) & 0xff;
-				p->b = NES_PALETTE[color] & 0xff;;
-			}		
-
-			// update texture once per frame (in blanking)
-			if (nes->scanline == V_RES && nes->cycle == 0) {
-				if (!frame_updated) {
-					// check for quit event
-					SDL_Event e;
-					if (SDL_PollEvent(&e)) {
-						if (e.type == SDL_QUIT) {
-							break;
-						}
-					}
-					frame_updated = true;
-					SDL_UpdateTexture(sdl_texture, NULL, screenbuffer, H_RES*sizeof(Pixel));
-					SDL_RenderClear(sdl_renderer);
-					SDL_RenderCopy(sdl_renderer, sdl_texture, NULL, NULL);
-					SDL_RenderPresent(sdl_renderer);
-					frame_count++;				
-
-					if (frame_count % 10 == 0)
-						printf("Frame #%d\n", frame_count);
-				}
-			} else
-				frame_updated = false;
+	if (wav_path || (live_audio && !headless)) {
+		if (!audio.start(wav_path, live_audio && !headless))
+			exit(1);
+		audio_on = true;
+	}
+	if (perf_path && !telemetry.start(perf_path))
+		exit(1);
+	if (cpu_trace_path && !cpu_trace.start(cpu_trace_path))
+		exit(1);
+	if (bus_prof_path && !bus_prof.start(bus_prof_path))
+		exit(1);
+#ifdef SIM_HDMI
+	if (!hdmi_dump.empty() || hdmi_hash_path || hdmi_wav_path) {
+		const VerilatedScope *scope = top->contextp()->scopeFind("TOP.nestang_top.u_hdmi.hdmi");
+		const VerilatedVar *var = scope ? scope->varFind("tmds_internal") : NULL;
+		if (!var) {
+			printf("No public signal TOP.nestang_top.u_hdmi.hdmi.tmds_internal\n");
+			exit(1);
+		}
+		tmds_symbols = (const uint16_t *)var->datap();
+		if (!tmds.start(hdmi_dump, frame_out.out_dir, hdmi_hash_path, hdmi_wav_path))
+			exit(1);
+	}
+#endif
 
-			sim_time++;
-			if (sim_time % 1000000 == 0) printf("Time: %ld million\n", sim_time / 1000000);
-		}	
-		printf("Simulation done, time=%lu\n", sim_time);
-		printf("Choose: (S)imulate, (E)nd, (T)race On, or (O)ff\n");
-		printf("  s 100m - simulate 100 million clock cycles\n");
-		printf("  s 0    - simulate forever\n");
-		printf("  s      - simulate 10 million clock cycles\n");
-		do {
+	if (!ppu_dump.empty() || (ppu_live && !headless)) {
+		string err;
+		if (!ppu_viewer.init(top, err)) {
+			printf("PPU viewer: %s\n", err.c_str());
+			exit(1);
+		}
+	}
+	if (socket_path && !console.listen(socket_path))
+		exit(1);
+#ifdef SIM_SAVABLE
+	// only useful when there is a prompt
+	if (!headless || socket_path)
+		rewind_buf.set_budget(rewind_mb << 20);
+#endif
+
+	start_ticks = chrono::steady_clock::now();
+	if (headless)
+		return sim_run();
+
+#ifndef NO_SDL
+	// Simulation runs on its own thread, the main thread presents frames
+	thread sim_thread([] { sim_run(); sim_done = true; });
+	if (!display_loop(frames, ppu_live ? &ppu_frames : NULL, sim_done, quit_requested)) {
+		quit_requested = true;
+		status = 1;
+	}
+	while (!sim_done) {
+		if (at_prompt) {
+			// window closed while waiting for a command
+			sim_thread.detach();
+			sim_finish();
+			return status;
+		}
+		this_thread::sleep_for(chrono::milliseconds(10));
+	}
+	sim_thread.join();
+#endif
+	return status;
+}
+
+// Handle a finished frame: display, pacing, frame output and per-frame hooks.
+// Returns false if the window was closed.
+static bool end_of_frame() {
+	frame_count++;
+	apply_input();
+	auto t0 = chrono::steady_clock::now(), t1 = t0;
+	if (!headless) {
+		// hand the frame to the display thread, never waits
+		if (pacing != PACE_EVERY_N || frame_count % present_every == 0) {
+			memcpy(frames.back(), frame_out.frame_idx, sizeof(frame_out.frame_idx));
+			frames.publish();
+			if (ppu_live) {
+				ppu_viewer.render(ppu_frames.back(), sdram_cpu);
+				ppu_frames.publish();
+			}
+		}
+		t1 = chrono::steady_clock::now();
+		if (pacing == PACE_REALTIME)
+			pace_realtime();
+		if (quit_requested)
+			return false;
+	}
+	auto t2 = chrono::steady_clock::now();
+	perf.present_ns = chrono::duration_cast<chrono::nanoseconds>(t1 - t0).count();
+	perf.pace_ns = chrono::duration_cast<chrono::nanoseconds>(t2 - t1).count();
+	if (int s = frame_out.end_frame(frame_count))
+		status = s;
+	if (!ppu_dump.empty() && frame_selected(frame_count, ppu_dump)) {
+		char fname[1024];
+		snprintf(fname, sizeof(fname), "%s/ppu_%05d.png", frame_out.out_dir.c_str(), frame_count);
+		if (write_ppu_sheet(fname))
+			frame_out.frames_written++;
+		else {
+			printf("Cannot write %s\n", fname);
+			status = 2;
+		}
+	}
+
+	perf.io_ns = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - t2).count();
+	if (bus_prof.active())
+		bus_prof.end_frame(frame_count);
+	if (rewind_buf.enabled())
+		rewind_due = true;
+	if (trigger)
+		trigger->frame(frame_count);
+	if (telemetry.active())
+		perf_frame();
+
+	if (!headless && frame_count % 10 == 0)
+		printf("Frame #%d\n", frame_count);
+	return true;
+}
+
+// One CPU cycle: feed the CPU trace and the checker
+static void cpu_cycle(Vnestang_top_NES *nes) {
+	CpuCycle c = {nes->cpu_addr, nes->cpu_din, (bool)nes->cpu_rnw, (bool)nes->cpu_sync,
+	              !nes->pause_cpu, nes->cpu_regs};
+	if (cpu_trace.active() && frame_count >= cpu_trace_from)
+		cpu_trace.cycle(c, frame_out.dot.scanline, frame_out.dot.cycle);
+	if (cpu_check_on) {
+		cpu_check.cycle(c, frame_out.dot.scanline, frame_out.dot.cycle);
+		if (cpu_check.failed) {
+			// stop like a breakpoint, at the first divergence of each run
+			cpu_check.failed = false;
+			printf("Frame %d: %s", frame_count, cpu_check.report.c_str());
+			status = 5;
+			breaks.hit = true;
+			breaks.reason = "CPU check failed";
+		}
+	}
+}
+
+#ifdef SIM_HDMI
+// The 74.25 MHz HDMI pixel clock, toggled between master clock edges by a phase
+// accumulator: 74.25 / 21.477272 pixel clock edges per master clock edge
+static void hdmi_clock() {
+	hclk_phase += 74250000;
+	while (hclk_phase >= 21477272) {
+		hclk_phase -= 21477272;
+		top->sim_hclk ^= 1;
+		top->eval();
+		if (top->sim_hclk && tmds_symbols)
+			tmds.push(tmds_symbols);
+	}
+}
+#endif
+
+// Run until the time/frame limit or a breakpoint. BP selects the per-clock
+// breakpoint checks (BP_*) compiled into the loop.
+template <unsigned BP>
+static void run_loop(Vnestang_top_NES *nes) {
+	while ((max_sim_time == 0 || sim_time < max_sim_time) &&
+	       (max_frames == 0 || frame_count < max_frames)) {
+		// top->sys_resetn = 1;
+		// if(sim_time > 1 && sim_time < 5){
+		// 	top->sys_resetn = 0;
+		// }
+		top->sys_clk ^= 1;
+		if (telemetry.active() && (sim_time & 15) < 2) {
+			// time a sample of evals, both clock edges, to keep the overhead low
+			uint64_t t = cpu_ticks();
+			top->eval();
+			perf.eval_ticks += (cpu_ticks() - t) * 8;
+		} else
+			top->eval();
+		if (trace && sim_time >= start_trace_time)
+			m_trace->dump(sim_time);
+		else if (trigger && trigger->dumping)
+			trigger->dump(sim_time);
+#ifdef SIM_HDMI
+		hdmi_clock();
+#endif
+
+		// All CPU logic is on the rising edge, so after the falling edge the pins
+		// hold what the next edge will see
+		if ((BP & BP_CPU) && !top->sys_clk && nes->cpu_ce)
+			cpu_cycle(nes);
+
+		// PPU outputs only change on rising edges. Sample them once per clock.
+		if (top->sys_clk) {
+			if (frame_out.clock(nes)) {
+				uint32_t scanline = frame_out.dot.scanline, cycle = frame_out.dot.cycle;
+
+				// update texture once per frame (in blanking)
+				bool frame_end = frame_out.frame_end();
+				if (frame_end && !end_of_frame())
+					break;
+				if (trigger && cycle == 0 && trigger->wants_scanlines())
+					trigger->scanline(frame_count, scanline);
+				if (breaks.dots)
+					breaks.check_dot(frame_count, scanline, cycle, frame_end);
+			}
+			if (trigger)
+				trigger->clock(nes, frame_count);
+
+			if ((BP & BP_PC) && nes->cpu_ce && nes->cpu_sync && breaks.pc[nes->cpu_addr])
+				breaks.pc_hit(nes->cpu_addr);
+			if ((BP & BP_BUS) && nes->cpu_ce && (nes->mw_int ? breaks.wr[nes->addr] : breaks.rd[nes->addr]))
+				breaks.bus_hit(nes->addr, nes->mw_int);
+			if (BP & BP_TRAFFIC) {
+				bus_prof.clock(nes->cpumem_addr, nes->cpumem_read, nes->cpumem_write,
+				               nes->ppumem_addr, nes->ppumem_read, nes->ppumem_write);
+				if (nes->cpu_ce)
+					bus_prof.cpu_cycle(nes->addr, nes->mw_int);
+			}
+			if (BP & BP_NMI) {
+				if (nes->nmi && !breaks.last_nmi)
+					breaks.nmi_hit();
+				breaks.last_nmi = nes->nmi;
+			}
+
+			// one APU sample per CPU cycle (12 master clocks). Halved like the HDMI audio path.
+			if (audio_on && ++apu_div == 12) {
+				apu_div = 0;
+				audio.push((int16_t)(nes->sample >> 1));
+			}
+		}
+
+		sim_time++;
+		if (rewind_due)
+			rewind_capture();
+		if (!headless && sim_time % 1000000 == 0) printf("Time: %ld million\n", sim_time / 1000000);
+		if (breaks.hit)
+			break;
+	}
+}
+
+// Run loop instances for all BP_* combinations
+template <unsigned BP>
+static void run_loop_for(unsigned bp, Vnestang_top_NES *nes) {
+	if (bp == BP)
+		run_loop<BP>(nes);
+	else
+		run_loop_for<(BP + 1) & BP_ALL>(bp, nes);
+}
+
+// Pick the run_loop() instance for the breakpoints and hooks in use
+static void run_until() {
+	Vnestang_top_NES *nes = top->nestang_top->nes;
+	breaks.hit = false;
+	breaks.last_nmi = nes->nmi;
+	unsigned bp = breaks.checks | (cpu_trace.active() || cpu_check_on ? BP_CPU : 0) |
+	              (bus_prof.active() ? BP_TRAFFIC : 0);
+	run_loop_for<0>(bp & BP_ALL, nes);
+	breaks.remove_once();
+}
+
+static void prompt_help() {
+	console.printf("Commands:\n");
+	console.printf("  s [N]          simulate N time steps (default 10m, 0 = forever), e.g. s 100m\n");
+	console.printf("  c              continue until a breakpoint\n");
+	console.printf("  u COND         run until COND or a breakpoint\n");
+	console.printf("  b COND         set a breakpoint\n");
+	console.printf("  d [ID]         delete breakpoint ID, or all of them\n");
+	console.printf("  i              show state and breakpoints\n");
+	console.printf("  t, o           trace on, off\n");
+	console.printf("  save F         save checkpoint to file F\n");
+	console.printf("  load F         restore checkpoint from file F\n");
+	console.printf("  r [N]          rewind N frames (default 1)\n");
+	console.printf("  mem A [N]      show N bytes of SDRAM at A (PRG $0, CHR $200000, CPU RAM $380000)\n");
+	console.printf("  poke A B...    write bytes B... to SDRAM at A\n");
+	console.printf("  memsave F A N  write N bytes of SDRAM at A to file F\n");
+	console.printf("  ppu F          write the PPU viewer sheet to F (PNG)\n");
+	console.printf("  e              end\n");
+	console.printf("COND: frame N | scanline S [dot D] | pc A | read/write/access A[-B] | mapper [A-B] | nmi\n");
+	console.printf("Addresses are $hex, 0xhex or decimal\n");
+}
+
+// $hex, 0xhex or decimal
+static bool parse_addr(const string &s, uint32_t &v) {
+	const char *p = s.c_str();
+	int base = 0;
+	if (*p == '$') {
+		p++;
+		base = 16;
+	}
+	char *end;
+	v = strtoul(p, &end, base);
+	return *p && *end == 0;
+}
+
+// mem, poke and memsave prompt commands. Returns false on bad arguments.
+static bool mem_command(const vector<string> &ss) {
+	uint32_t a, n = 64, b;
+	if (ss.size() < 2 || !parse_addr(ss[ss[0] == "memsave" ? 2 : 1], a))
+		return false;
+	if (ss[0] == "mem") {
+		if (ss.size() > 2 && !parse_addr(ss[2], n))
+			return false;
+		vector<uint8_t> d = sdram_cpu.snapshot(a, n);
+		for (uint32_t i = 0; i < n; i += 16) {
 			string line;
-			std::getline(cin, line);
-			vector<string> ss = tokenize(line);
-			if (ss.size() == 0) continue;
-			transform(ss[0].begin(), ss[0].end(), ss[0].begin(), ::tolower); 
-			if (ss[0] == "s" || ss[0] == "simulate") {
-				long long cycles = 10000000LL;
-				if (ss.size() > 1) {
-					cycles = parse_num(ss[1]);
-					if (cycles == -1) {
-						cout << "Cannot parse number: " << ss[1] << endl;
-						continue;
-					}
+			char h[8];
+			for (uint32_t j = i; j < i + 16 && j < n; j++) {
+				snprintf(h, sizeof(h), " %02X", d[j]);
+				line += h;
+			}
+			console.printf("%06X:%s\n", (a + i) & (sdram_cpu.size() - 1), line.c_str());
+		}
+	} else if (ss[0] == "poke") {
+		for (size_t i = 2; i < ss.size(); i++) {
+			if (!parse_addr(ss[i], b) || b > 255)
+				return false;
+			sdram_cpu.write8(a + i - 2, b);
+		}
+	} else {
+		if (ss.size() != 4 || !parse_addr(ss[3], n))
+			return false;
+		vector<uint8_t> d = sdram_cpu.snapshot(a, n);
+		FILE *f = fopen(ss[1].c_str(), "wb");
+		if (!f || fwrite(d.data(), 1, n, f) != n) {
+			console.printf("Cannot write %s\n", ss[1].c_str());
+			if (f)
+				fclose(f);
+			return true;
+		}
+		fclose(f);
+		console.printf("%u bytes written to %s\n", n, ss[1].c_str());
+	}
+	return true;
+}
+
+static void print_state() {
+	Vnestang_top_NES *nes = top->nestang_top->nes;
+	console.printf("Time %lu, frame %d, scanline %d, dot %d, cpu $%04X\n", (unsigned long)sim_time,
+	               frame_count, frame_out.dot.scanline, frame_out.dot.cycle, nes->cpu_addr);
+}
+
+// Read commands until one that runs the simulation. Returns false to end.
+static bool prompt() {
+	while (true) {
+		string line;
+		at_prompt = true;
+		bool eof = !console.read_line(line);
+		at_prompt = false;
+		if (eof)
+			return false;
+		vector<string> ss = tokenize(line);
+		if (ss.size() == 0) continue;
+		transform(ss[0].begin(), ss[0].end(), ss[0].begin(), ::tolower);
+		string err;
+		bool ok = true;
+		if (ss[0] == "s" || ss[0] == "simulate") {
+			long long cycles = 10000000LL;
+			if (ss.size() > 1) {
+				cycles = parse_num(ss[1]);
+				if (cycles == -1) {
+					console.printf("Cannot parse number: %s\n", ss[1].c_str());
+					console.done(false);
+					continue;
 				}
-				max_sim_time += cycles;
-				break;
-			} else if (ss[0] == "e" || ss[0] == "end") {
-				done = true;
-				break;
-			} else if (ss[0] == "t" || ss[0] == "trace") {
-				cout << "trace on" << endl;
-				trace_on();
-			} else if (ss[0] == "o" || ss[0] == "off") {
-				cout << "trace off" << endl;
-				trace_off();
 			}
-		} while (1);
+			max_sim_time = cycles ? sim_time + cycles : 0;
+			return true;
+		} else if (ss[0] == "c" || ss[0] == "continue") {
+			max_sim_time = 0;
+			return true;
+		} else if (ss[0] == "u" || ss[0] == "until" || ss[0] == "b" || ss[0] == "break") {
+			Breakpoint b;
+			if (!Breakpoints::parse(ss, 1, b, err)) {
+				console.printf("%s\n", err.c_str());
+				console.done(false);
+				continue;
+			}
+			if (ss[0][0] == 'u') {
+				b.once = true;
+				breaks.add(b);
+				max_sim_time = 0;
+				return true;
+			}
+			console.printf("Breakpoint %d: %s\n", breaks.add(b), b.str().c_str());
+		} else if (ss[0] == "d" || ss[0] == "delete") {
+			if (ss.size() == 1)
+				breaks.remove_all();
+			else if (!breaks.remove(atoi(ss[1].c_str()))) {
+				console.printf("No breakpoint %s\n", ss[1].c_str());
+				ok = false;
+			}
+		} else if (ss[0] == "i" || ss[0] == "info") {
+			print_state();
+			for (auto &b : breaks.list())
+				console.printf("  %d: %s\n", b.id, b.str().c_str());
+			if (rewind_buf.count())
+				console.printf("Rewind: frames %d-%d, %.1f MB, capture %.0f us per frame\n",
+				               rewind_buf.oldest_frame(), rewind_buf.newest_frame(), rewind_buf.bytes() / 1048576.0,
+				               rewind_buf.capture_ns / 1000.0 / rewind_buf.captures);
+		} else if (ss[0] == "r" || ss[0] == "rewind") {
+			long long n = ss.size() > 1 ? parse_num(ss[1]) : 1;
+			if (n <= 0) {
+				console.printf("Cannot parse number: %s\n", ss[1].c_str());
+				ok = false;
+			} else if (!rewind_buf.enabled()) {
+				console.printf("Rewind is off, it needs -R and the single-threaded model\n");
+				ok = false;
+			} else if (!rewind_frames(n)) {
+				console.printf("Cannot rewind %lld frames, the buffer goes back to frame %d\n", n,
+				               rewind_buf.oldest_frame());
+				ok = false;
+			} else
+				print_state();
+		} else if (ss[0] == "e" || ss[0] == "end") {
+			console.done(true);
+			return false;
+		} else if (ss[0] == "t" || ss[0] == "trace") {
+			console.printf("trace on\n");
+			trace_on();
+			trace = true;
+			start_trace_time = sim_time;
+		} else if (ss[0] == "o" || ss[0] == "off") {
+			console.printf("trace off\n");
+			trace_off();
+			trace = false;
+		} else if (ss[0] == "save" && ss.size() > 1) {
+			ok = save_checkpoint(ss[1].c_str());
+		} else if (ss[0] == "load" && ss.size() > 1) {
+			ok = load_checkpoint(ss[1].c_str());
+			if (ok)
+				print_state();
+		} else if (ss[0] == "mem" || ss[0] == "poke" || ss[0] == "memsave") {
+			ok = mem_command(ss);
+			if (!ok)
+				console.printf("Usage: mem A [N], poke A B..., memsave F A N\n");
+		} else if (ss[0] == "ppu" && ss.size() > 1) {
+			if (!ppu_viewer.ready() && !ppu_viewer.init(top, err)) {
+				console.printf("PPU viewer: %s\n", err.c_str());
+				ok = false;
+			} else if (!write_ppu_sheet(ss[1].c_str())) {
+				console.printf("Cannot write %s\n", ss[1].c_str());
+				ok = false;
+			} else
+				console.printf("PPU sheet written to %s\n", ss[1].c_str());
+		} else if (ss[0] == "h" || ss[0] == "help" || ss[0] == "?") {
+			prompt_help();
+		} else {
+			console.printf("Unknown command: %s\n", line.c_str());
+			ok = false;
+		}
+		console.done(ok);
+	}
+}
+
+// Main simulation loop, including the interactive prompt. Returns exit status.
+int sim_run(bool finish) {
+	bool help_shown = false;
+	while (true) {
+		perf_reset();
+		run_until();
+		if (save_path) {
+			if (!save_checkpoint(save_path))
+				status = 2;
+			save_path = NULL;
+		}
+		if ((headless && !console.has_socket()) || quit_requested)
+			break;
+		if (max_frames != 0 && frame_count >= max_frames) {
+			// frame limit is one-shot, further runs are by cycles
+			max_frames = 0;
+			max_sim_time = sim_time;
+		}	
+		if (!help_shown) {
+			prompt_help();
+			help_shown = true;
+		}
+		if (breaks.hit)
+			console.printf("Stopped, %s\n", breaks.reason.c_str());
+		print_state();
+		console.done(true);
+		if (!prompt())
+			break;
 	}
+	console.close();
 
+	if (finish)
+		sim_finish();
+	return status;
+}
+
+// Close trace, free the model and print stats
+void sim_finish() {
 	if (m_trace)
 		m_trace->close();
+	if (trigger)
+		trigger->finish();
+	unsigned model_threads = top->contextp()->threads();
 	delete top;
+	audio.stop();
+	telemetry.stop();
+	cpu_trace.stop();
+	bus_prof.stop();
+#ifdef SIM_HDMI
+	tmds.stop();
+#endif
+	if (frame_out.hash_file)
+		fclose(frame_out.hash_file);
+	console.close();
 
     // calculate frame rate
-    uint64_t end_ticks = SDL_GetPerformanceCounter();
-    double duration = ((double)(end_ticks-start_ticks))/SDL_GetPerformanceFrequency();
-    double fps = (double)frame_count/duration;
-    printf("Frames per second: %.1f\n", fps);	
+    double duration = chrono::duration<double>(chrono::steady_clock::now() - start_ticks).count();
+    double fps = (double)(frame_count - start_frame)/duration;
+	if (headless) {
+		// machine-readable stats, one JSON object on its own line
+		printf("{\"frames\":%d,\"sim_time\":%llu,\"cycles\":%llu,\"wall_s\":%.3f,\"fps\":%.2f,"
+		       "\"cycles_per_sec\":%.0f,\"threads\":%u,\"mappers\":\"%s\",\"frames_written\":%d,"
+		       "\"golden_checked\":%d,\"golden_mismatches\":%d,\"status\":%d",
+		       frame_count, (unsigned long long)sim_time, (unsigned long long)sim_time/2, duration, fps,
+		       (sim_time - start_sim_time)/2/duration, model_threads, model_mappers, frame_out.frames_written,
+		       frame_out.golden_checked, frame_out.golden_mismatches, status);
+		if (job_id >= 0)
+			printf(",\"job\":%d", job_id);
+		if (breaks.hit)
+			printf(",\"break\":\"%s\"", breaks.reason.c_str());
+		if (cpu_check_on)
+			printf(",\"cpu_checked\":%llu,\"cpu_skipped\":%llu,\"cpu_errors\":%llu",
+			       (unsigned long long)cpu_check.steps, (unsigned long long)cpu_check.skipped,
+			       (unsigned long long)cpu_check.errors);
+#ifdef SIM_HDMI
+		if (tmds_symbols)
+			printf(",\"hdmi_frames\":%llu,\"hdmi_frames_written\":%d,\"hdmi_samples\":%llu,\"hdmi_errors\":%llu",
+			       (unsigned long long)tmds.frames, tmds.frames_written, (unsigned long long)tmds.samples,
+			       (unsigned long long)tmds.errors);
+#endif
+		printf("}\n");
+	} else
+    	printf("Frames per second: %.1f\n", fps);	
+}
+
+// Fork server. The warm-up run (reset, ROM load, title screen...) happens once in
+// this process. Each job line then continues from that state in a forked child,
+// which shares the model and the SDRAM arrays with us copy-on-write.
+int fork_server() {
+	if (top->contextp()->threads() > 1) {
+		printf("Fork server needs the single-threaded model, model threads do not survive fork()\n");
+		return 1;
+	}
+	sim_run(false);
+	if (status)
+		return status;
+	double warm_s = chrono::duration<double>(chrono::steady_clock::now() - start_ticks).count();
+
+	FILE *f = strcmp(fork_jobs, "-") == 0 ? stdin : fopen(fork_jobs, "r");
+	if (!f) {
+		printf("Cannot open %s\n", fork_jobs);
+		return 1;
+	}
+	int parallel = fork_parallel > 0 ? fork_parallel : max(1u, thread::hardware_concurrency());
+	map<pid_t,int> running;			// pid -> job id
+	int njobs = 0, failed = 0;
+	auto reap = [&]() {
+		int wstatus;
+		pid_t pid = wait(&wstatus);
+		auto it = running.find(pid);
+		if (pid <= 0 || it == running.end())
+			return;
+		if (!WIFEXITED(wstatus) || WEXITSTATUS(wstatus) != 0) {
+			failed++;
+			fprintf(stderr, "job %d failed (%s %d)\n", it->second,
+			        WIFEXITED(wstatus) ? "status" : "signal",
+			        WIFEXITED(wstatus) ? WEXITSTATUS(wstatus) : WTERMSIG(wstatus));
+		}
+		running.erase(it);
+	};
+
+	char line[4096];
+	while (fgets(line, sizeof(line), f)) {
+		line[strcspn(line, "\r\n")] = 0;
+		vector<string> args = tokenize(line);
+		if (args.empty() || args[0][0] == '#')
+			continue;
+		while ((int)running.size() >= parallel)
+			reap();
+		fflush(NULL);				// or buffered output gets written twice
+		pid_t pid = fork();
+		if (pid < 0) {
+			perror("fork");
+			failed++;
+			break;
+		}
+		if (pid == 0) {
+			int r = run_job(njobs, args);
+			fflush(stdout);
+			_exit(r);				// exit() could reposition the shared job file
+		}
+		running[pid] = njobs++;
+	}
+	if (f != stdin)
+		fclose(f);
+	while (!running.empty())
+		reap();
+
+	double duration = chrono::duration<double>(chrono::steady_clock::now() - start_ticks).count();
+	printf("{\"jobs\":%d,\"failed\":%d,\"warm_frames\":%d,\"warm_sim_time\":%llu,\"warm_s\":%.3f,\"wall_s\":%.3f}\n",
+	       njobs, failed, frame_count, (unsigned long long)sim_time, warm_s, duration);
+	return failed ? 4 : 0;
+}
 
-    SDL_DestroyTexture(sdl_texture);
-    SDL_DestroyRenderer(sdl_renderer);
-    SDL_DestroyWindow(sdl_window);
-    SDL_Quit();
+// One fork-server job, in the child. Starts from the warm state with default run
+// options, then applies the job line. -c and -f count from the warm-up point.
+int run_job(int id, vector<string> &args) {
+	job_id = id;
+	max_sim_time = 0;
+	max_frames = 0;
+	frame_out.dump_frames.clear();
+	ppu_dump.clear();
+	frame_out.out_dir = ".";
+	save_path = NULL;
+	wav_path = NULL;
+	trace = false;
+	start_trace_time = 0;
+	trigger = NULL;
+	perf_path = NULL;
+	cpu_trace_path = NULL;
+	cpu_trace_from = 0;
+	cpu_check_on = false;
+	bus_prof_path = NULL;
+	frame_out.hash_file = NULL;
+	frame_out.golden.clear();
+	frame_out.golden_checked = frame_out.golden_mismatches = 0;
+	frame_out.frames_written = 0;
+	breaks.remove_all();
 
-	return 0;
+	vector<char *> argv;
+	argv.push_back((char *)"job");
+	for (auto &a : args)
+		argv.push_back(&a[0]);
+	for (int i = 1; i < (int)argv.size(); i++) {
+		int next = parse_run_option(argv.size(), argv.data(), i);
+		if (!next) {
+			printf("job %d: unknown option %s\n", id, argv[i]);
+			return 1;
+		}
+		i = next;
+	}
+	if (max_sim_time == 0 && max_frames == 0) {
+		printf("job %d: needs -c or -f\n", id);
+		return 1;
+	}
+	if (max_sim_time)
+		max_sim_time += sim_time;
+	if (max_frames)
+		max_frames += frame_count;
+	start_sim_time = sim_time;
+	start_frame = frame_count;
+	apply_input();
+
+	if (trace)
+		trace_on();
+	if (trigger)
+		trigger_on();
+	if (wav_path) {
+		if (!audio.start(wav_path, false))
+			return 1;
+		audio_on = true;
+	}
+	if (perf_path && !telemetry.start(perf_path))
+		return 1;
+	if (cpu_trace_path && !cpu_trace.start(cpu_trace_path))
+		return 1;
+	if (bus_prof_path && !bus_prof.start(bus_prof_path))
+		return 1;
+	string err;
+	if (!ppu_dump.empty() && !ppu_viewer.init(top, err)) {
+		printf("job %d: PPU viewer: %s\n", id, err.c_str());
+		return 1;
+	}
+	start_ticks = chrono::steady_clock::now();
+	return sim_run();
+}
+
+// Sleep so that frames come out at the NTSC rate. If the sim cannot keep up, it
+// just runs as fast as it can without trying to catch up later.
+void pace_realtime() {
+	static const chrono::nanoseconds period(16639267);		// 1 / 60.0988 Hz
+	static chrono::steady_clock::time_point next = chrono::steady_clock::now();
+	next += period;
+	auto now = chrono::steady_clock::now();
+	if (next > now)
+		this_thread::sleep_until(next);
+	else if (now - next > 4*period)
+		next = now;
 }
 
 bool is_space(char c) {
@@ -256,6 +1165,247 @@ long long parse_num(string s) {
 	return atoll(s.c_str()) * times;
 }
 
+// parse a frame list like "1,60,100-110" or "all"
+bool parse_frame_list(string s, vector<pair<long long,long long>> &r) {
+	if (s == "all") {
+		r.push_back(make_pair(1LL, LLONG_MAX));
+		return true;
+	}
+	size_t pos = 0;
+	while (pos < s.size()) {
+		size_t comma = s.find(',', pos);
+		if (comma == string::npos) comma = s.size();
+		string item = s.substr(pos, comma - pos);
+		size_t dash = item.find('-');
+		long long from, to;
+		if (dash == string::npos) {
+			from = to = parse_num(item);
+		} else {
+			from = parse_num(item.substr(0, dash));
+			to = parse_num(item.substr(dash+1));
+		}
+		if (from <= 0 || to < from)
+			return false;
+		r.push_back(make_pair(from, to));
+		pos = comma + 1;
+	}
+	return true;
+}
+
+bool frame_selected(long long frame, const vector<pair<long long,long long>> &list) {
+	for (auto &p : list)
+		if (frame >= p.first && frame <= p.second)
+			return true;
+	return false;
+}
+
+// Run this command line again with the mapper-specific model, if it is built:
+// obj_dir_mmc3/Vnestang_top for obj_dir/Vnestang_top. Returns if there is none.
+void switch_model(char **argv, const char *variant) {
+	char self[PATH_MAX];
+	ssize_t n = readlink("/proc/self/exe", self, sizeof(self) - 1);
+	if (n > 0)
+		self[n] = 0;
+	else if (!realpath(argv[0], self))
+		return;
+	string path = self;
+	size_t slash = path.rfind('/');
+	if (slash == string::npos)
+		return;
+	path.insert(slash, string("_") + variant);
+	if (access(path.c_str(), X_OK) != 0)
+		return;
+	if (!headless)
+		printf("Switching to the %s model: %s\n", variant, path.c_str());
+	fflush(stdout);
+	execv(path.c_str(), argv);
+	printf("Cannot run %s, staying on the full model\n", path.c_str());
+}
+
+// Render the PPU viewer sheet for the current state and write it as PNG
+bool write_ppu_sheet(const char *fname) {
+	static uint8_t sheet[PPU_VIEW_W*PPU_VIEW_H];
+	static Pixel pixels[PPU_VIEW_W*PPU_VIEW_H];
+	ppu_viewer.render(sheet, sdram_cpu);
+	convert_pixels(pixels, sheet, PPU_VIEW_W*PPU_VIEW_H);
+	return write_png(fname, pixels, PPU_VIEW_W, PPU_VIEW_H);
+}
+
+// Golden hash file: one "<frame> <hash in hex>" per line, # starts a comment
+bool load_golden(const char *fname, map<long long,uint64_t> &golden) {
+	FILE *f = fopen(fname, "r");
+	if (!f) {
+		printf("Cannot open %s\n", fname);
+		return false;
+	}
+	char line[256];
+	int lineno = 0;
+	while (fgets(line, sizeof(line), f)) {
+		lineno++;
+		long long frame;
+		unsigned long long h;
+		char *p = line;
+		while (is_space(*p)) p++;
+		if (*p == '#' || *p == '\n' || *p == '\r' || *p == 0)
+			continue;
+		if (sscanf(p, "%lld %llx", &frame, &h) != 2) {
+			printf("%s:%d: cannot parse golden hash\n", fname, lineno);
+			fclose(f);
+			return false;
+		}
+		golden[frame] = h;
+	}
+	fclose(f);
+	return true;
+}
+
+// Map PRG/CHR into simulated SDRAM at the addresses GameLoader would use, and set
+// mapper_flags. GameData then ends loading right away so the NES starts running
+// right after reset.
+void preload_rom(Vnestang_top *top, SparseMem &mem, const NesRom &rom) {
+	Vnestang_top_nestang_top *t = top->nestang_top;
+	mem.map(SDRAM_PRG_BASE, rom.image, rom.prg_offset, rom.prg_size);
+	if (rom.chr_size)
+		mem.map(SDRAM_CHR_BASE, rom.image, rom.chr_offset, rom.chr_size);
+	t->mapper_flags = rom.mapper_flags;
+	t->game_data->preloaded = 1;
+}
+
+// Checkpoint file: magic, version, harness state, the Verilator model state, then
+// the SDRAM pages in use. With mapper_flags in the model, no ROM is needed to restore.
+const char CHECKPOINT_MAGIC[8] = {'N','T','C','K','P','T','0','4'};
+
+#ifdef SIM_SAVABLE
+// Harness and model state, as in checkpoints and rewind snapshots. Rewind
+// snapshots leave out the SDRAM pages still mapped from the ROM image.
+static void save_state(VerilatedSerialize &os, bool rewind = false) {
+	uint64_t t = sim_time;
+	uint32_t frame = frame_count;
+	os << t << frame << frame_out.dot.scanline << frame_out.dot.cycle << frame_out.dot.color;
+	os.write(frame_out.frame_idx, sizeof(frame_out.frame_idx));
+	os << *top;
+	if (rewind) {
+		sdram_cpu.save_written(os);
+		sdram_rv.save_written(os);
+	} else {
+		sdram_cpu.save(os);
+		sdram_rv.save(os);
+	}
+}
+
+static void restore_state(VerilatedDeserialize &os, bool rewind = false) {
+	uint64_t t;
+	uint32_t frame;
+	os >> t >> frame >> frame_out.dot.scanline >> frame_out.dot.cycle >> frame_out.dot.color;
+	os.read(frame_out.frame_idx, sizeof(frame_out.frame_idx));
+	os >> *top;
+	if (rewind) {
+		sdram_cpu.restore_written(os);
+		sdram_rv.restore_written(os);
+	} else {
+		sdram_cpu.restore(os);
+		sdram_rv.restore(os);
+	}
+	sim_time = t;
+	frame_count = frame;
+}
+
+bool save_checkpoint(const char *fname) {
+	VerilatedSave os;
+	os.open(fname);
+	if (!os.isOpen()) {
+		printf("Cannot open %s\n", fname);
+		return false;
+	}
+	os.write(CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+	char model[8] = {0};
+	memcpy(model, model_mappers, min(strlen(model_mappers), sizeof(model)));
+	os.write(model, sizeof(model));
+	save_state(os);
+	os.close();
+	printf("Checkpoint saved to %s at time=%llu, frame=%d\n", fname, (unsigned long long)sim_time, frame_count);
+	return true;
+}
+
+bool load_checkpoint(const char *fname) {
+	VerilatedRestore os;
+	os.open(fname);
+	if (!os.isOpen()) {
+		printf("Cannot open %s\n", fname);
+		return false;
+	}
+	char magic[sizeof(CHECKPOINT_MAGIC)];
+	os.read(magic, sizeof(magic));
+	if (memcmp(magic, CHECKPOINT_MAGIC, sizeof(magic)) != 0) {
+		printf("%s is not a checkpoint file\n", fname);
+		os.close();
+		return false;
+	}
+	// the model layout differs between mapper-specific models
+	char model[9] = {0};
+	os.read(model, 8);
+	if (strcmp(model, model_mappers) != 0) {
+		printf("%s was saved by the MAPPERS=%s model, this is the MAPPERS=%s one\n", fname, model, model_mappers);
+		os.close();
+		return false;
+	}
+	restore_state(os);
+	os.close();
+	// earlier snapshots only hold the pages written over the old ROM mapping
+	rewind_buf.clear();
+	convert_pixels(frame_out.pixels, frame_out.frame_idx, H_RES*V_RES);
+	printf("Checkpoint restored from %s at time=%llu, frame=%d\n", fname, (unsigned long long)sim_time, frame_count);
+	return true;
+}
+
+// Snapshot for the rewind buffer, at the end of the clock that finished a frame
+void rewind_capture() {
+	rewind_due = false;
+	auto t0 = chrono::steady_clock::now();
+	{
+		MemSave os(rewind_buf.next());
+		save_state(os, true);
+	}
+	rewind_buf.commit(sim_time, frame_count);
+	rewind_buf.capture_ns += chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - t0).count();
+}
+
+// Go back n frames. Returns false if the buffer does not reach back that far.
+bool rewind_frames(long long n) {
+	// a snapshot of right now does not count
+	if (rewind_buf.newest_time() == sim_time)
+		n++;
+	vector<uint8_t> s;
+	if (!rewind_buf.rewind(n, s))
+		return false;
+	MemRestore os(s.data(), s.size());
+	restore_state(os, true);
+	convert_pixels(frame_out.pixels, frame_out.frame_idx, H_RES*V_RES);
+	if (!headless) {
+		memcpy(frames.back(), frame_out.frame_idx, sizeof(frame_out.frame_idx));
+		frames.publish();
+	}
+	return true;
+}
+#else
+bool save_checkpoint(const char *fname) {
+	printf("Checkpoints need a model verilated with --savable (single-threaded build)\n");
+	return false;
+}
+
+bool load_checkpoint(const char *fname) {
+	return save_checkpoint(fname);
+}
+
+void rewind_capture() {
+	rewind_due = false;
+}
+
+bool rewind_frames(long long n) {
+	return false;
+}
+#endif
+
 void trace_on() {
 	if (!m_trace) {
 		//m_trace = new VerilatedVcdC;
@@ -263,7 +1413,64 @@ void trace_on() {
 		m_trace = new VerilatedFstC;
 		top->trace(m_trace, 5);
 		Verilated::traceEverOn(true);
-		m_trace->open("waveform.fst");
+		m_trace->open((frame_out.out_dir + "/waveform.fst").c_str());
+	}
+}
+
+// Start counting a new frame, e.g. when the run (re)starts
+void perf_reset() {
+	perf.start = chrono::steady_clock::now();
+	perf.ticks = cpu_ticks();
+	perf.eval_ticks = 0;
+	perf.sim_time = sim_time;
+}
+
+// Send this frame's counters to the telemetry writer. A sample of eval() calls is
+// timed with the cheap cpu_ticks(), and their share of the frame is scaled to wall time.
+void perf_frame() {
+	auto now = chrono::steady_clock::now();
+	uint64_t ticks = cpu_ticks();
+	FrameStats s;
+	s.frame = frame_count;
+	s.sim_time = sim_time;
+	s.half_cycles = sim_time - perf.sim_time + 1;
+	s.wall_ns = chrono::duration_cast<chrono::nanoseconds>(now - perf.start).count();
+	s.eval_ns = ticks > perf.ticks ? (uint64_t)((double)s.wall_ns * perf.eval_ticks / (ticks - perf.ticks)) : 0;
+	s.eval_ns = min(s.eval_ns, s.wall_ns);
+	s.present_ns = perf.present_ns;
+	s.pace_ns = perf.pace_ns;
+	s.io_ns = perf.io_ns;
+	s.trace_bytes = trace_bytes();
+	telemetry.push(s);
+	perf.start = now;
+	perf.ticks = ticks;
+	perf.eval_ticks = 0;
+	perf.sim_time = sim_time + 1;
+}
+
+// Trace output written so far
+uint64_t trace_bytes() {
+	uint64_t n = trigger ? trigger->bytes_written() : 0;
+	struct stat st;
+	if (m_trace && stat((frame_out.out_dir + "/waveform.fst").c_str(), &st) == 0)
+		n += st.st_size;
+	return n;
+}
+
+// Set controller state for the current frame from the input movie
+void apply_input() {
+	frame_out.apply_input(top, frame_count);
+}
+
+void trigger_on() {
+	if (trace) {
+		printf("-t and -T cannot be used together\n");
+		exit(1);
+	}
+	string err;
+	if (!trigger->start(top, frame_out.out_dir, frame_count, err)) {
+		printf("%s\n", err.c_str());
+		exit(1);
 	}
 }
 
@@ -0,0 +1,76 @@
+# Shared by the scripts that drive the headless simulator (regress.py,
+# bench_mappers.py, profile_report.py): ROM manifests, running one simulation
+# and reading its JSON stats, and the command line options they have in common.
+
+import json
+import os
+import subprocess
+import sys
+
+DIR = os.path.dirname(os.path.abspath(__file__))
+
+
+# Manifest lines: <name> <rom> [more fields], '#' starts a comment. Yields the
+# line number and the fields, with the ROM path made relative to the manifest.
+def manifest_lines(fname):
+    base = os.path.dirname(os.path.abspath(fname))
+    with open(fname) as f:
+        for lineno, line in enumerate(f, 1):
+            fields = line.split('#', 1)[0].split()
+            if not fields:
+                continue
+            if len(fields) >= 2:
+                fields[1] = os.path.join(base, fields[1])
+            yield lineno, fields
+
+
+def manifest_path(fname, path):
+    return os.path.join(os.path.dirname(os.path.abspath(fname)), path)
+
+
+# the entries named on the command line, all of them if none are
+def select_entries(entries, names):
+    if not names:
+        return entries
+    unknown = set(names) - set(e.name for e in entries)
+    if unknown:
+        sys.exit('not in manifest: ' + ' '.join(sorted(unknown)))
+    return [e for e in entries if e.name in names]
+
+
+def add_sim_args(ap, obj_dir='obj_headless', json_out=True):
+    ap.add_argument('--sim', default=os.path.join(DIR, obj_dir, 'Vnestang_top'))
+    ap.add_argument('--timeout', type=int, default=3600, help='seconds per ROM')
+    if json_out:
+        ap.add_argument('--json', help='also write the results to this file')
+
+
+# after parse_args: absolute --sim, which must exist
+def check_sim(args, make='make headless'):
+    args.sim = os.path.abspath(args.sim)
+    if not os.path.exists(args.sim):
+        sys.exit('%s not found, run %s first' % (args.sim, make))
+
+
+# Runs the simulator (-H -c 0 and the options given) and returns the stats it
+# prints as a JSON line, its output, and an error message or None.
+def run_sim(args, options, env=None):
+    cmd = [args.sim, '-H', '-c', '0'] + options
+    try:
+        # the model reads roms/ relative to the working dir, so run next to the binary
+        p = subprocess.run(cmd, cwd=os.path.dirname(args.sim), env=env, stdout=subprocess.PIPE,
+                           stderr=subprocess.STDOUT, timeout=args.timeout, universal_newlines=True)
+    except subprocess.TimeoutExpired:
+        return None, '', 'timeout after %ds' % args.timeout
+    stats = None
+    for line in p.stdout.splitlines():
+        if line.startswith('{'):
+            stats = json.loads(line)
+    if stats is None:
+        return None, p.stdout, 'simulator failed:\n' + p.stdout[-2000:]
+    return stats, p.stdout, None
+
+
+def write_json(fname, results):
+    with open(fname, 'w') as f:
+        json.dump(results, f, indent=1)
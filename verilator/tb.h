@@ -0,0 +1,55 @@
+#pragma once
+
+// Common parts of the standalone block testbenches (tb_apu, tb_ppu, tb_t65,
+// built by make tb-apu etc.). Each one verilates a single block of src/ as its
+// own top module, drives its ports from C++, runs a short functional check and
+// then a microbenchmark. Speed is reported in master clock cycles (21.477 MHz)
+// per second, the unit of the full model's cycles_per_sec, so the numbers show
+// what each block costs out of the whole system.
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// Options every testbench takes. Returns the index of the last argument consumed,
+// or 0 if argv[i] is not one of them.
+struct TbOptions {
+	uint64_t bench_clocks;          // -c: master clocks to run the benchmark for
+	bool check = true;              // -n: skip the functional check
+
+	explicit TbOptions(uint64_t clocks) : bench_clocks(clocks) {}
+
+	int parse(int argc, char **argv, int i) {
+		if (strcmp(argv[i], "-c") == 0 && i+1 < argc)
+			bench_clocks = strtoull(argv[++i], NULL, 10);
+		else if (strcmp(argv[i], "-n") == 0)
+			check = false;
+		else
+			return 0;
+		return i;
+	}
+
+	static void usage() {
+		printf("  -c N   run the benchmark for N master clock cycles\n");
+		printf("  -n     skip the functional check\n");
+	}
+};
+
+class TbTimer {
+public:
+	void start() { t0 = std::chrono::steady_clock::now(); }
+	double seconds() const {
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+	}
+private:
+	std::chrono::steady_clock::time_point t0;
+};
+
+// One JSON line, like the simulator's headless stats: {"block":..,"cycles":..,...}.
+// extra is more fields, starting with a comma.
+inline void tb_report(const char *block, uint64_t clocks, double wall_s, int status, const char *extra = "") {
+	printf("{\"block\":\"%s\",\"cycles\":%llu,\"wall_s\":%.3f,\"cycles_per_sec\":%.0f%s,\"status\":%d}\n",
+	       block, (unsigned long long)clocks, wall_s, wall_s > 0 ? clocks / wall_s : 0.0, extra, status);
+}
@@ -0,0 +1,161 @@
+// Standalone APU testbench and microbenchmark (make tb-apu), see tb.h.
+//
+// Drives src/apu.v the way nes.v does: a CPU cycle every 12 master clocks, PHI2
+// high for the second half of it, and register writes held on the bus for one
+// CPU cycle. DMC fetches are answered from a C++ sample buffer.
+//
+// Check: pulse 1 plays a 440 Hz square wave, whose frequency is measured from
+// the samples. Benchmark: all five channels play while the APU runs alone.
+
+#include <cmath>
+#include <string>
+
+#include "VAPU.h"
+#include "verilated.h"
+#include "audio.h"
+#include "tb.h"
+
+using namespace std;
+
+static VAPU *apu;
+static int div_cpu = 1;             // 1-12, the CPU cycle ends on 12 as in nes.v
+static uint64_t clocks;
+static uint8_t dmc_rom[4096];       // $C000-$CFFF as the DMC sees it
+static bool wav;
+
+// One master clock, both edges
+static void tick() {
+	apu->ce = div_cpu == 12;
+	apu->PHI2 = div_cpu > 4 && div_cpu < 12;
+	apu->clk = 1;
+	apu->eval();
+	apu->clk = 0;
+	apu->eval();
+	if (apu->ce)
+		apu->odd_or_even ^= 1;
+	div_cpu = div_cpu == 12 ? 1 : div_cpu + 1;
+	clocks++;
+}
+
+// One CPU cycle, with an optional register write ($4000-$4017)
+static void cpu_cycle(bool write = false, uint16_t addr = 0, uint8_t v = 0) {
+	apu->CS = write;
+	apu->RW = !write;
+	apu->ADDR = addr & 31;
+	apu->DIN = v;
+	// the DMA unit answers a DMC request on the next cycle
+	apu->DmaAck = apu->DmaReq;
+	apu->DmaData = dmc_rom[apu->DmaAddr & 0xfff];
+	do
+		tick();
+	while (div_cpu != 1);
+	if (wav)
+		audio.push((int16_t)((0xffff - apu->Sample) >> 1));     // inverted and halved as in nes.v and sim_main
+}
+
+static void write_reg(uint16_t addr, uint8_t v) {
+	cpu_cycle(true, addr, v);
+	cpu_cycle();
+}
+
+static void reset() {
+	apu->reset = apu->cold_reset = 1;
+	apu->odd_or_even = 1;
+	for (int i = 0; i < 8; i++)
+		cpu_cycle();
+	apu->reset = apu->cold_reset = 0;
+	cpu_cycle();
+	write_reg(0x4017, 0x40);        // frame counter IRQ off
+}
+
+// Pulse 1 at 1789773 / (16 * 254) = 440.4 Hz, 50% duty, constant volume
+static bool check_pulse() {
+	reset();
+	write_reg(0x4015, 0x01);
+	write_reg(0x4000, 0xbf);
+	write_reg(0x4001, 0x08);
+	write_reg(0x4002, 0xfd);
+	write_reg(0x4003, 0x00);
+	const int n = 447443;           // a quarter of a second
+	uint16_t last = apu->Sample, lo = last, hi = last;
+	int rising = 0;
+	for (int i = 0; i < n; i++) {
+		cpu_cycle();
+		uint16_t s = apu->Sample;
+		if (s > last)
+			rising++;
+		lo = min(lo, s);
+		hi = max(hi, s);
+		last = s;
+	}
+	double expect = 1789773.0 / (16 * 254), got = rising * 1789773.0 / n;
+	bool ok = hi > lo && fabs(got - expect) < expect * 0.02;
+	printf("Pulse 1: %.1f Hz (expected %.1f), samples %u-%u: %s\n", got, expect, lo, hi, ok ? "ok" : "FAILED");
+	return ok;
+}
+
+// All channels on: pulses, triangle, noise and a looping DMC sample
+static void start_all_channels() {
+	reset();
+	for (int i = 0; i < (int)sizeof(dmc_rom); i++)
+		dmc_rom[i] = (uint8_t)(i * 37 + 11);
+	static const uint8_t regs[][2] = {
+		{0x15, 0x1f},
+		{0x00, 0xbf}, {0x01, 0x08}, {0x02, 0xfd}, {0x03, 0x00},     // pulse 1
+		{0x04, 0x7a}, {0x05, 0x99}, {0x06, 0x40}, {0x07, 0x01},     // pulse 2, sweeping
+		{0x08, 0xff}, {0x0a, 0x80}, {0x0b, 0x00},                   // triangle
+		{0x0c, 0x3c}, {0x0e, 0x05}, {0x0f, 0x00},                   // noise
+		{0x10, 0x4f}, {0x11, 0x40}, {0x12, 0x00}, {0x13, 0xff},     // DMC, loop, $C000
+		{0x15, 0x1f},
+	};
+	for (auto &r : regs)
+		write_reg(0x4000 | r[0], r[1]);
+}
+
+int main(int argc, char **argv) {
+	Verilated::commandArgs(argc, argv);
+	TbOptions opt(200000000);       // about 9 seconds of NES time
+	const char *wav_path = NULL;
+	for (int i = 1; i < argc; i++) {
+		int next = opt.parse(argc, argv, i);
+		if (next)
+			i = next;
+		else if (strcmp(argv[i], "-a") == 0 && i+1 < argc)
+			wav_path = argv[++i];
+		else {
+			printf("Usage: %s [options]\n", argv[0]);
+			TbOptions::usage();
+			printf("  -a F   write the benchmark's audio to F (48 kHz mono WAV)\n");
+			return 1;
+		}
+	}
+
+	apu = new VAPU;
+	apu->MMC5 = 0;
+	apu->PAL = 0;
+	apu->allow_us = 0;
+	apu->audio_channels = 0x1f;
+
+	int status = 0;
+	if (opt.check && !check_pulse())
+		status = 1;
+
+	start_all_channels();
+	if (wav_path) {
+		if (!audio.start(wav_path, false))
+			return 1;
+		wav = true;
+	}
+	TbTimer timer;
+	timer.start();
+	uint64_t start = clocks;
+	while (clocks - start < opt.bench_clocks)
+		cpu_cycle();
+	double wall = timer.seconds();
+	if (wav)
+		audio.stop();
+
+	tb_report("apu", clocks - start, wall, status);
+	delete apu;
+	return status;
+}
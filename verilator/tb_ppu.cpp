@@ -0,0 +1,226 @@
+// Standalone PPU testbench and microbenchmark (make tb-ppu), see tb.h.
+//
+// Drives src/ppu.v with a PPU cycle every 4 master clocks as in nes.v. VRAM is a
+// C++ model: 8KB of CHR and 2KB of nametable RAM, mirrored vertically. Like the
+// SDRAM path in the full system, a read returns its data on the next PPU cycle.
+// Register reads and writes are held for one PPU cycle. Pixels are captured the
+// way sim_main does, one 6-bit color per dot.
+//
+// Check: a checkerboard nametable, written through $2006/$2007, renders as a
+// checkerboard, and a frame is 341x262 dots (one less on odd frames).
+// Benchmark: background and 64 sprites on, frames run back to back.
+
+#include <string>
+
+#include "VPPU.h"
+#include "verilated.h"
+#include "video.h"
+#include "tb.h"
+
+using namespace std;
+
+static VPPU *ppu;
+static int div_ppu = 1;             // 1-4, the PPU cycle ends on 4 as in nes.v
+static uint64_t clocks;
+static uint8_t chr[0x2000];
+static uint8_t ciram[0x800];
+
+static uint8_t frame[H_RES*V_RES];
+static uint32_t dot_scanline = 511, dot_cycle = 511, dot_color;
+static uint64_t frames, frame_start;    // completed frames, clock of the last frame end
+static uint64_t frame_len;              // master clocks in the last frame
+
+static uint8_t &vram(uint16_t a) {
+	return a & 0x2000 ? ciram[a & 0x7ff] : chr[a & 0x1fff];
+}
+
+// One master clock, both edges
+static void tick() {
+	bool ce = div_ppu == 4;
+	ppu->ce = ce;
+	// the bus as it is before the edge
+	bool rd = ce && ppu->vram_r, wr = ce && ppu->vram_w;
+	uint16_t a = ppu->vram_a;
+	uint8_t d = ppu->vram_dout;
+	ppu->clk = 1;
+	ppu->eval();
+	if (wr)
+		vram(a) = d;
+	if (rd)
+		ppu->vram_din = vram(a);
+	ppu->clk = 0;
+	ppu->eval();
+	div_ppu = div_ppu == 4 ? 1 : div_ppu + 1;
+	clocks++;
+
+	// record a dot's color when the PPU moves on, as in sim_main
+	uint32_t cycle = ppu->cycle;
+	if (cycle != dot_cycle) {
+		if (dot_scanline < V_RES && dot_cycle < H_RES)
+			frame[dot_scanline*H_RES + dot_cycle] = dot_color;
+		dot_cycle = cycle;
+		dot_scanline = ppu->scanline;
+		if (dot_scanline == V_RES && cycle == 0) {
+			frames++;
+			frame_len = clocks - frame_start;
+			frame_start = clocks;
+		}
+	}
+	dot_color = ppu->color;
+}
+
+// One PPU cycle, with an optional register access ($2000-$2007)
+static uint8_t ppu_cycle(bool read = false, bool write = false, uint16_t addr = 0, uint8_t v = 0) {
+	ppu->read = read;
+	ppu->write = write;
+	ppu->ain = addr & 7;
+	ppu->din = v;
+	do
+		tick();
+	while (div_ppu != 1);
+	ppu->read = ppu->write = 0;
+	return ppu->dout;
+}
+
+// A register write, then a few idle cycles like a CPU cycle
+static void write_reg(uint16_t addr, uint8_t v) {
+	ppu_cycle(false, true, addr, v);
+	for (int i = 0; i < 2; i++)
+		ppu_cycle();
+}
+
+static void run_frames(uint64_t n) {
+	uint64_t end = frames + n;
+	while (frames < end)
+		ppu_cycle();
+}
+
+static void set_vram_addr(uint16_t a) {
+	write_reg(0x2006, a >> 8);
+	write_reg(0x2006, a & 0xff);
+}
+
+static void reset() {
+	ppu->reset = 1;
+	for (int i = 0; i < 16; i++)
+		ppu_cycle();
+	ppu->reset = 0;
+	write_reg(0x2000, 0x00);
+	write_reg(0x2001, 0x00);
+}
+
+// Tile 0 blank, tile 1 solid color 3, tile 2 a diagonal for sprites
+static void load_chr() {
+	memset(chr, 0, sizeof(chr));
+	memset(&chr[16], 0xff, 16);
+	for (int r = 0; r < 8; r++)
+		chr[32 + r] = chr[32 + 8 + r] = 0x80 >> r;
+}
+
+// Background palette 0 and a sprite palette, then the nametable, through $2007
+static void load_screen() {
+	static const uint8_t pal[] = {0x0f, 0x16, 0x27, 0x30, 0x0f, 0x01, 0x11, 0x21,
+	                              0x0f, 0x06, 0x16, 0x26, 0x0f, 0x09, 0x19, 0x29,
+	                              0x0f, 0x14, 0x24, 0x34, 0x0f, 0x02, 0x12, 0x22};
+	set_vram_addr(0x3f00);
+	for (uint8_t c : pal)
+		write_reg(0x2007, c);
+	set_vram_addr(0x2000);
+	for (int i = 0; i < 1024; i++) {
+		// checkerboard tiles, then the attribute table with palette 0 everywhere
+		uint8_t t = i < 960 && ((i & 31) + (i >> 5)) % 2 ? 1 : 0;
+		write_reg(0x2007, t);
+	}
+	set_vram_addr(0);
+	write_reg(0x2005, 0);
+	write_reg(0x2005, 0);
+}
+
+static bool check_checkerboard() {
+	reset();
+	load_chr();
+	load_screen();
+	write_reg(0x2001, 0x0a);        // background on, including the left 8 pixels
+	run_frames(3);                  // rendering starts on a frame boundary
+	uint64_t len1 = frame_len;
+	run_frames(1);
+	uint64_t len2 = frame_len;
+
+	int match = 0;
+	for (int y = 0; y < V_RES; y++)
+		for (int x = 0; x < H_RES; x++)
+			match += frame[y*H_RES + x] == (((x >> 3) + (y >> 3)) % 2 ? 0x30 : 0x0f);
+	double pct = match * 100.0 / (H_RES*V_RES);
+	// 341x262 dots of 4 clocks, odd frames skip a dot when rendering
+	const uint64_t even = 341*262*4, odd = even - 4;
+	bool len_ok = (len1 == even && len2 == odd) || (len1 == odd && len2 == even);
+	bool ok = pct > 90 && len_ok;
+	printf("Checkerboard: %.1f%% of pixels as expected, frames of %llu and %llu clocks: %s\n", pct,
+	       (unsigned long long)len1, (unsigned long long)len2, ok ? "ok" : "FAILED");
+	return ok;
+}
+
+// 64 sprites in OAM through $2003/$2004, eight per line at most
+static void load_sprites() {
+	write_reg(0x2003, 0);
+	for (int i = 0; i < 64; i++) {
+		write_reg(0x2004, 16 + (i / 8) * 24);   // y
+		write_reg(0x2004, 2);                   // tile
+		write_reg(0x2004, i & 3);               // palette
+		write_reg(0x2004, 8 + (i % 8) * 30);    // x
+	}
+}
+
+int main(int argc, char **argv) {
+	Verilated::commandArgs(argc, argv);
+	TbOptions opt(100000000);       // about 280 frames
+	const char *ppm_path = NULL;
+	for (int i = 1; i < argc; i++) {
+		int next = opt.parse(argc, argv, i);
+		if (next)
+			i = next;
+		else if (strcmp(argv[i], "-w") == 0 && i+1 < argc)
+			ppm_path = argv[++i];
+		else {
+			printf("Usage: %s [options]\n", argv[0]);
+			TbOptions::usage();
+			printf("  -w F   write the last frame of the benchmark to F (PPM)\n");
+			return 1;
+		}
+	}
+
+	ppu = new VPPU;
+	ppu->sys_type = 0;
+
+	int status = 0;
+	if (opt.check && !check_checkerboard())
+		status = 1;
+
+	reset();
+	load_chr();
+	load_screen();
+	load_sprites();
+	write_reg(0x2001, 0x1e);        // background and sprites on
+
+	TbTimer timer;
+	timer.start();
+	uint64_t start = clocks, start_frames = frames;
+	while (clocks - start < opt.bench_clocks)
+		ppu_cycle();
+	double wall = timer.seconds();
+
+	if (ppm_path) {
+		static Pixel pixels[H_RES*V_RES];
+		convert_pixels(pixels, frame, H_RES*V_RES);
+		if (!write_ppm(ppm_path, pixels)) {
+			printf("Cannot write %s\n", ppm_path);
+			status = 2;
+		}
+	}
+	char extra[64];
+	snprintf(extra, sizeof(extra), ",\"frames\":%llu,\"fps\":%.2f", (unsigned long long)(frames - start_frames),
+	         (frames - start_frames) / wall);
+	tb_report("ppu", clocks - start, wall, status, extra);
+	delete ppu;
+	return status;
+}
@@ -0,0 +1,206 @@
+// Standalone T65 testbench and microbenchmark (make tb-t65), see tb.h.
+//
+// Drives src/t65 as the NES CPU (6502 mode, no decimal) with 64KB of flat C++
+// RAM. The CPU is enabled every 12th master clock as in nes.v, or every -d N.
+// Reads see the RAM at the address the CPU put out, and writes land at the end
+// of their cycle.
+//
+// Check: a built-in program (or -l FILE) runs under the lockstep 6502 checker
+// of cpucheck.h, which must find no divergence. Benchmark: the same program
+// without the checker.
+
+#include <string>
+#include <vector>
+
+#include "VT65.h"
+#include "verilated.h"
+#include "cpucheck.h"
+#include "tb.h"
+
+using namespace std;
+
+static VT65 *cpu;
+static int divider = 12;            // master clocks per CPU cycle
+static int div_cpu = 1;
+static uint64_t clocks, cpu_cycles;
+static uint8_t ram[0x10000];
+static CpuChecker *checker;
+
+// Loops over page $02 doing loads, stores, ALU ops, shifts, a subroutine and the
+// stack, with every addressing mode the loop needs. Runs forever.
+static const uint8_t program[] = {
+	0xa2, 0xff,             // 0400  LDX #$FF
+	0x9a,                   // 0402  TXS
+	0xa9, 0x00,             // 0403  LDA #$00
+	0x85, 0x10,             // 0405  STA $10
+	0x85, 0x11,             // 0407  STA $11
+	0xa0, 0x00,             // 0409  LDY #$00       outer
+	0x98,                   // 040B  TYA            loop
+	0x45, 0x12,             // 040C  EOR $12
+	0x0a,                   // 040E  ASL A
+	0x26, 0x13,             // 040F  ROL $13
+	0x99, 0x00, 0x02,       // 0411  STA $0200,Y
+	0x18,                   // 0414  CLC
+	0x65, 0x10,             // 0415  ADC $10
+	0x85, 0x10,             // 0417  STA $10
+	0xa5, 0x11,             // 0419  LDA $11
+	0x69, 0x00,             // 041B  ADC #$00
+	0x85, 0x11,             // 041D  STA $11
+	0x20, 0x2c, 0x04,       // 041F  JSR $042C
+	0xc8,                   // 0422  INY
+	0xd0, 0xe6,             // 0423  BNE loop
+	0xe6, 0x12,             // 0425  INC $12
+	0x4c, 0x09, 0x04,       // 0427  JMP outer
+	0xea, 0xea,             // 042A  NOP NOP
+	0x48,                   // 042C  PHA            sub
+	0xbe, 0x00, 0x02,       // 042D  LDX $0200,Y
+	0xca,                   // 0430  DEX
+	0x8a,                   // 0431  TXA
+	0x5d, 0x00, 0x03,       // 0432  EOR $0300,X
+	0x9d, 0x00, 0x03,       // 0435  STA $0300,X
+	0x68,                   // 0438  PLA
+	0x60,                   // 0439  RTS
+	0x40,                   // 043A  RTI            NMI and IRQ
+};
+
+// One master clock, both edges
+static void tick() {
+	bool ce = div_cpu == divider;
+	cpu->Enable = ce;
+	if (ce) {
+		uint16_t a = cpu->A;
+		if (cpu->R_W_n)
+			cpu->DI = ram[a];
+		if (checker) {
+			CpuCycle c = {a, cpu->R_W_n ? cpu->DI : cpu->DO, (bool)cpu->R_W_n, (bool)cpu->Sync, true, cpu->Regs};
+			checker->cycle(c, 0, 0);
+		}
+		if (!cpu->R_W_n)
+			ram[a] = cpu->DO;
+		cpu_cycles++;
+	}
+	cpu->Clk = 1;
+	cpu->eval();
+	cpu->Clk = 0;
+	cpu->eval();
+	div_cpu = ce ? 1 : div_cpu + 1;
+	clocks++;
+}
+
+static void reset() {
+	cpu->Res_n = 0;
+	for (int i = 0; i < 8 * divider; i++)
+		tick();
+	cpu->Res_n = 1;
+}
+
+static bool check(uint64_t n) {
+	CpuChecker c;
+	checker = &c;
+	reset();
+	uint64_t end = cpu_cycles + n;
+	while (cpu_cycles < end && !c.failed)
+		tick();
+	checker = NULL;
+	if (c.failed)
+		printf("%s", c.report.c_str());
+	bool ok = c.steps > 0 && c.errors == 0;
+	printf("Lockstep check: %llu instructions, %llu skipped, %llu diverging: %s\n", (unsigned long long)c.steps,
+	       (unsigned long long)c.skipped, (unsigned long long)c.errors, ok ? "ok" : "FAILED");
+	return ok;
+}
+
+// -l FILE[@ADDR]: a raw image at ADDR (default 0)
+static bool load_image(string path) {
+	uint32_t at = 0;
+	size_t sep = path.rfind('@');
+	if (sep != string::npos) {
+		at = strtoul(path.c_str() + sep + 1, NULL, 0);
+		path.resize(sep);
+	}
+	FILE *f = fopen(path.c_str(), "rb");
+	if (!f || at > 0xffff) {
+		printf("Cannot load %s\n", path.c_str());
+		if (f)
+			fclose(f);
+		return false;
+	}
+	size_t n = fread(&ram[at], 1, 0x10000 - at, f);
+	fclose(f);
+	printf("Loaded %zu bytes at $%04X\n", n, at);
+	return true;
+}
+
+int main(int argc, char **argv) {
+	Verilated::commandArgs(argc, argv);
+	TbOptions opt(200000000);       // about 16.7 million CPU cycles
+	uint64_t check_cycles = 1000000;
+	const char *image = NULL;
+	long reset_vector = -1;
+	for (int i = 1; i < argc; i++) {
+		int next = opt.parse(argc, argv, i);
+		if (next)
+			i = next;
+		else if (strcmp(argv[i], "-d") == 0 && i+1 < argc && atoi(argv[i+1]) > 0)
+			divider = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-k") == 0 && i+1 < argc)
+			check_cycles = strtoull(argv[++i], NULL, 10);
+		else if (strcmp(argv[i], "-l") == 0 && i+1 < argc)
+			image = argv[++i];
+		else if (strcmp(argv[i], "-r") == 0 && i+1 < argc)
+			reset_vector = strtol(argv[++i], NULL, 0);
+		else {
+			printf("Usage: %s [options]\n", argv[0]);
+			TbOptions::usage();
+			printf("  -d N   master clocks per CPU cycle (default 12, 1 = the CPU alone at full speed)\n");
+			printf("  -k N   CPU cycles to run under the lockstep checker (default 1000000)\n");
+			printf("  -l F[@A] run the raw image F loaded at A (default 0) instead of the built-in program\n");
+			printf("  -r A   reset vector\n");
+			return 1;
+		}
+	}
+
+	if (image) {
+		if (!load_image(image))
+			return 1;
+	} else {
+		memcpy(&ram[0x400], program, sizeof(program));
+		ram[0xfffa] = ram[0xfffe] = 0x3a;       // NMI, IRQ
+		ram[0xfffb] = ram[0xffff] = 0x04;
+		reset_vector = 0x400;
+	}
+	if (reset_vector >= 0) {
+		ram[0xfffc] = reset_vector & 0xff;
+		ram[0xfffd] = reset_vector >> 8 & 0xff;
+	}
+	vector<uint8_t> initial(ram, ram + sizeof(ram));
+
+	cpu = new VT65;
+	cpu->Mode = 0;
+	cpu->BCD_en = 0;
+	cpu->Rdy = 1;
+	cpu->Abort_n = 1;
+	cpu->IRQ_n = 1;
+	cpu->NMI_n = 1;
+	cpu->SO_n = 1;
+
+	int status = 0;
+	if (opt.check && !check(check_cycles))
+		status = 1;
+
+	memcpy(ram, initial.data(), sizeof(ram));
+	reset();
+	TbTimer timer;
+	timer.start();
+	uint64_t start = clocks, start_cycles = cpu_cycles;
+	while (clocks - start < opt.bench_clocks)
+		tick();
+	double wall = timer.seconds();
+
+	char extra[96];
+	snprintf(extra, sizeof(extra), ",\"divider\":%d,\"cpu_cycles\":%llu,\"cpu_cycles_per_sec\":%.0f", divider,
+	         (unsigned long long)(cpu_cycles - start_cycles), (cpu_cycles - start_cycles) / wall);
+	tb_report("t65", clocks - start, wall, status, extra);
+	delete cpu;
+	return status;
+}
@@ -0,0 +1,61 @@
+// Per-frame telemetry writer, see telemetry.h
+
+#include <chrono>
+#include <cstring>
+
+#include "telemetry.h"
+
+using namespace std;
+
+bool Telemetry::start(const char *path) {
+	f = fopen(path, "w");
+	if (!f) {
+		printf("Cannot open %s\n", path);
+		return false;
+	}
+	size_t len = strlen(path);
+	json = len > 5 && strcmp(path + len - 5, ".json") == 0;
+	if (!json)
+		fprintf(f, "frame,sim_time,half_cycles,wall_ns,eval_ns,harness_ns,present_ns,pace_ns,io_ns,trace_bytes\n");
+	stopping = false;
+	running = true;
+	thread = std::thread(&Telemetry::worker, this);
+	return true;
+}
+
+void Telemetry::worker() {
+	FrameStats s;
+	while (true) {
+		if (!ring.pop(s)) {
+			if (stopping)
+				break;
+			this_thread::sleep_for(chrono::milliseconds(5));
+			continue;
+		}
+		uint64_t other = s.eval_ns + s.present_ns + s.pace_ns + s.io_ns;
+		uint64_t harness = s.wall_ns > other ? s.wall_ns - other : 0;
+		if (json)
+			fprintf(f, "{\"frame\":%u,\"sim_time\":%llu,\"half_cycles\":%u,\"wall_ns\":%llu,\"eval_ns\":%llu,"
+			        "\"harness_ns\":%llu,\"present_ns\":%llu,\"pace_ns\":%llu,\"io_ns\":%llu,\"trace_bytes\":%llu}\n",
+			        s.frame, (unsigned long long)s.sim_time, s.half_cycles, (unsigned long long)s.wall_ns,
+			        (unsigned long long)s.eval_ns, (unsigned long long)harness, (unsigned long long)s.present_ns,
+			        (unsigned long long)s.pace_ns, (unsigned long long)s.io_ns, (unsigned long long)s.trace_bytes);
+		else
+			fprintf(f, "%u,%llu,%u,%llu,%llu,%llu,%llu,%llu,%llu,%llu\n",
+			        s.frame, (unsigned long long)s.sim_time, s.half_cycles, (unsigned long long)s.wall_ns,
+			        (unsigned long long)s.eval_ns, (unsigned long long)harness, (unsigned long long)s.present_ns,
+			        (unsigned long long)s.pace_ns, (unsigned long long)s.io_ns, (unsigned long long)s.trace_bytes);
+	}
+}
+
+void Telemetry::stop() {
+	if (!running)
+		return;
+	stopping = true;
+	thread.join();
+	running = false;
+	fclose(f);
+	f = NULL;
+	if (dropped)
+		printf("Telemetry: %llu frames dropped\n", (unsigned long long)dropped);
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <thread>
+
+#include "ring.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Cheap timestamp for timing every eval(). Only ratios of these are used, so the
+// unit does not matter.
+static inline uint64_t cpu_ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#elif defined(__aarch64__)
+	uint64_t t;
+	asm volatile("mrs %0, cntvct_el0" : "=r"(t));
+	return t;
+#else
+	return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+}
+
+// Per-frame performance counters
+struct FrameStats {
+	uint32_t frame;
+	uint64_t sim_time;              // at the end of the frame
+	uint32_t half_cycles;           // eval() calls in the frame
+	uint64_t wall_ns;
+	uint64_t eval_ns;               // time inside eval()
+	uint64_t present_ns;            // handing the frame to the display
+	uint64_t pace_ns;               // sleeping for -p realtime
+	uint64_t io_ns;                 // writing frames, hashing
+	uint64_t trace_bytes;           // trace output so far
+};
+
+// Per-frame telemetry (sim_main -P). Records go through a lock-free ring to a
+// writer thread, so the sim loop never waits on the file. Output is CSV, or JSON
+// lines if the file name ends in .json.
+class Telemetry {
+public:
+	bool start(const char *path);
+	void stop();
+	bool active() const { return running; }
+
+	void push(const FrameStats &s) {
+		if (!ring.push(s))
+			dropped++;
+	}
+
+	uint64_t dropped = 0;
+
+private:
+	void worker();
+
+	SpscRing<FrameStats, 1024> ring;
+	std::thread thread;
+	std::atomic<bool> stopping{false};
+	bool running = false;
+	bool json = false;
+	FILE *f = NULL;
+};
@@ -0,0 +1,316 @@
+// HDMI output decoding, see tmds.h
+
+#include <chrono>
+#include <cstring>
+
+#include "tmds.h"
+#include "audio.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define HAVE_AVX2_PATH
+#endif
+
+using namespace std;
+
+// HDMI 1.4a 5.2.2.1 and 5.2.3.3
+static const uint32_t VIDEO_GUARD_02 = 0x2cc;       // channels 0 and 2 in a video guard band
+static const uint32_t GUARD_1 = 0x133;              // channel 1 in both guard bands, 2 in data island ones
+
+static const uint16_t TERC4[16] = {
+	0x29c, 0x263, 0x2e4, 0x2e2, 0x171, 0x11e, 0x18e, 0x13c,
+	0x2cc, 0x139, 0x19c, 0x2c6, 0x28e, 0x271, 0x163, 0x2c3,
+};
+
+// symbol tables, by 10-bit symbol
+static struct TmdsLut {
+	uint32_t video[1024];       // TMDS 8b/10b decoded byte
+	int8_t ctl[1024];           // control period code, -1 if none
+	int8_t terc4[1024];         // TERC4 code, -1 if none
+	TmdsLut() {
+		for (int q = 0; q < 1024; q++) {
+			uint32_t d = q & 512 ? ~q & 255 : q & 255;
+			video[q] = (d ^ (d << 1) ^ (q & 256 ? 0 : 0xfe)) & 255;
+			ctl[q] = terc4[q] = -1;
+		}
+		ctl[0x354] = 0; ctl[0x0ab] = 1; ctl[0x154] = 2; ctl[0x2ab] = 3;
+		for (int i = 0; i < 16; i++)
+			terc4[TERC4[i]] = i;
+	}
+} lut;
+
+static void decode_video_scalar(uint32_t *dst, const uint32_t *s, int n) {
+	for (int i = 0; i < n; i++)
+		dst[i] = lut.video[s[i] & 0x3ff] | lut.video[s[i] >> 10 & 0x3ff] << 8 | lut.video[s[i] >> 20] << 16;
+}
+
+#ifdef HAVE_AVX2_PATH
+__attribute__((target("avx2")))
+static void decode_video_avx2(uint32_t *dst, const uint32_t *s, int n) {
+	const __m256i mask = _mm256_set1_epi32(0x3ff);
+	const int *t = (const int *)lut.video;
+	int i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)(s + i));
+		__m256i b = _mm256_i32gather_epi32(t, _mm256_and_si256(v, mask), 4);
+		__m256i g = _mm256_i32gather_epi32(t, _mm256_and_si256(_mm256_srli_epi32(v, 10), mask), 4);
+		__m256i r = _mm256_i32gather_epi32(t, _mm256_srli_epi32(v, 20), 4);
+		__m256i px = _mm256_or_si256(b, _mm256_or_si256(_mm256_slli_epi32(g, 8), _mm256_slli_epi32(r, 16)));
+		_mm256_storeu_si256((__m256i *)(dst + i), px);
+	}
+	decode_video_scalar(dst + i, s + i, n - i);
+}
+#endif
+
+static void decode_video(uint32_t *dst, const uint32_t *s, int n) {
+#ifdef HAVE_AVX2_PATH
+	static const bool avx2 = __builtin_cpu_supports("avx2");
+	if (avx2) {
+		decode_video_avx2(dst, s, n);
+		return;
+	}
+#endif
+	decode_video_scalar(dst, s, n);
+}
+
+// BCH ECC of a data island packet part, HDMI 1.4a 5.2.3.4
+static uint8_t packet_ecc(uint64_t bits, int n) {
+	uint8_t ecc = 0;
+	for (int i = 0; i < n; i++)
+		ecc = (ecc >> 1) ^ (((ecc ^ (bits >> i)) & 1) ? 0x83 : 0);
+	return ecc;
+}
+
+bool TmdsDecoder::start(const vector<pair<long long,long long>> &frames, const string &dir,
+                        const char *hash_path, const char *wav_path) {
+	dump = frames;
+	out_dir = dir;
+	if (hash_path && !(hash_file = fopen(hash_path, "w"))) {
+		printf("Cannot open %s\n", hash_path);
+		return false;
+	}
+	if (wav_path) {
+		if (!(wav = fopen(wav_path, "wb"))) {
+			printf("Cannot open %s\n", wav_path);
+			return false;
+		}
+		write_wav_header(wav, 0, 2);
+	}
+	frame.assign(HDMI_W * HDMI_H, 0);
+	running = true;
+	thread = std::thread(&TmdsDecoder::worker, this);
+	return true;
+}
+
+void TmdsDecoder::worker() {
+	while (true) {
+		Block *b = blocks.front();
+		if (!b) {
+			if (stopping)
+				break;
+			this_thread::sleep_for(chrono::milliseconds(1));
+			continue;
+		}
+		decode(b->s, b->n);
+		blocks.pop_commit();
+	}
+}
+
+void TmdsDecoder::decode(const uint32_t *s, int n) {
+	for (int i = 0; i < n; ) {
+		uint32_t c0 = s[i] & 0x3ff, c1 = s[i] >> 10 & 0x3ff, c2 = s[i] >> 20;
+
+		// the video data period starts after the 2 guard band symbols
+		if (period == VIDEO_GUARD && guard_n == 2) {
+			period = VIDEO;
+			x = 0;
+			if (vsync_idle < 0)
+				vsync_idle = vsync;
+		}
+		if (period == VIDEO) {
+			// video symbols have at most 5 transitions, control symbols 7, so the
+			// first control symbol ends the period
+			int j = i;
+			while (j < n && lut.ctl[s[j] & 0x3ff] < 0)
+				j++;
+			if (synced && y < HDMI_H && x < HDMI_W)
+				decode_video(&frame[y * HDMI_W + x], s + i, min(j - i, HDMI_W - x));
+			x += j - i;
+			i = j;
+			if (i == n)
+				break;
+			end_line();
+			period = CONTROL;
+			continue;
+		}
+		i++;
+
+		if (c1 == GUARD_1 && c2 == GUARD_1) {
+			// data island guard band, channel 0 is TERC4 with the syncs
+			int t = lut.terc4[c0];
+			if (t < 0)
+				error();
+			else
+				set_vsync(t >> 1 & 1);
+			if (period == ISLAND && pos != 0)
+				error();
+			period = period == ISLAND || period == ISLAND_END ? ISLAND_END : ISLAND_GUARD;
+			pos = 0;
+		} else if (c0 == VIDEO_GUARD_02 && c1 == GUARD_1 && c2 == VIDEO_GUARD_02) {
+			if (period != VIDEO_GUARD) {
+				period = VIDEO_GUARD;
+				guard_n = 0;
+			}
+			guard_n++;
+		} else if (period == ISLAND_GUARD || period == ISLAND) {
+			int t0 = lut.terc4[c0], t1 = lut.terc4[c1], t2 = lut.terc4[c2];
+			if (t0 < 0 || t1 < 0 || t2 < 0) {
+				error();
+				t0 = max(t0, 0); t1 = max(t1, 0); t2 = max(t2, 0);
+			}
+			if (period == ISLAND_GUARD) {
+				period = ISLAND;
+				pos = 0;
+				header = 0;
+				memset(sub, 0, sizeof(sub));
+			}
+			set_vsync(t0 >> 1 & 1);
+			// channel 0 bit 2: header bit, channels 1 and 2: 2 bits of each subpacket
+			header |= (t0 >> 2 & 1) << pos;
+			for (int k = 0; k < 4; k++)
+				sub[k] |= (uint64_t)(t1 >> k & 1) << (2 * pos) | (uint64_t)(t2 >> k & 1) << (2 * pos + 1);
+			if (++pos == 32) {
+				packet();
+				pos = 0;
+				header = 0;
+				memset(sub, 0, sizeof(sub));
+			}
+		} else if (lut.ctl[c0] >= 0) {
+			if (lut.ctl[c1] < 0 || lut.ctl[c2] < 0)
+				error();
+			set_vsync(lut.ctl[c0] >> 1);
+			period = CONTROL;
+		} else
+			error();
+	}
+	if (wav && !audio_buf.empty()) {
+		fwrite(audio_buf.data(), 2, audio_buf.size(), wav);
+		wav_samples += audio_buf.size() / 2;
+		audio_buf.clear();
+	}
+}
+
+void TmdsDecoder::set_vsync(bool v) {
+	if (v == vsync)
+		return;
+	vsync = v;
+	if (vsync_idle >= 0 && v != vsync_idle)
+		end_frame();
+}
+
+void TmdsDecoder::end_line() {
+	if (!synced)
+		return;
+	if (x != HDMI_W)
+		errors++;
+	y++;
+}
+
+void TmdsDecoder::end_frame() {
+	if (!synced) {
+		// the first vsync: frames start here
+		synced = true;
+		y = 0;
+		return;
+	}
+	if (y != HDMI_H) {
+		errors++;
+		y = 0;
+		return;
+	}
+	y = 0;
+	uint64_t n = ++frames;
+	if (hash_file) {
+		// FNV-1a over the R, G, B bytes
+		uint64_t h = 0xcbf29ce484222325ULL;
+		for (uint32_t p : frame)
+			for (int sh = 16; sh >= 0; sh -= 8) {
+				h ^= p >> sh & 255;
+				h *= 0x100000001b3ULL;
+			}
+		fprintf(hash_file, "%llu %016llx\n", (unsigned long long)n, (unsigned long long)h);
+	}
+	for (auto &r : dump) {
+		if ((long long)n < r.first || (long long)n > r.second)
+			continue;
+		char fname[1024];
+		snprintf(fname, sizeof(fname), "%s/hdmi_%05llu.ppm", out_dir.c_str(), (unsigned long long)n);
+		FILE *f = fopen(fname, "wb");
+		if (!f) {
+			printf("Cannot write %s\n", fname);
+			break;
+		}
+		fprintf(f, "P6\n%d %d\n255\n", HDMI_W, HDMI_H);
+		vector<uint8_t> line(HDMI_W * 3);
+		for (int yy = 0; yy < HDMI_H; yy++) {
+			for (int xx = 0; xx < HDMI_W; xx++) {
+				uint32_t p = frame[yy * HDMI_W + xx];
+				line[xx*3] = p >> 16;
+				line[xx*3+1] = p >> 8;
+				line[xx*3+2] = p;
+			}
+			fwrite(line.data(), 1, line.size(), f);
+		}
+		if (fclose(f) == 0)
+			frames_written++;
+		break;
+	}
+}
+
+void TmdsDecoder::packet() {
+	if (packet_ecc(header, 24) != (header >> 24 & 255)) {
+		error();
+		return;
+	}
+	for (int k = 0; k < 4; k++)
+		if (packet_ecc(sub[k], 56) != (sub[k] >> 56 & 255)) {
+			error();
+			return;
+		}
+	packets++;
+	if ((header & 255) != 0x02)
+		return;
+	// audio sample packet: header bits 8-11 flag the subpackets with a sample.
+	// Each has 24-bit left and right words, with 16-bit audio in the top bits.
+	for (int k = 0; k < 4; k++) {
+		if (!(header >> (8 + k) & 1))
+			continue;
+		samples++;
+		if (wav) {
+			audio_buf.push_back((int16_t)(sub[k] >> 8));
+			audio_buf.push_back((int16_t)(sub[k] >> 32));
+		}
+	}
+}
+
+void TmdsDecoder::stop() {
+	if (!running)
+		return;
+	if (blk && blk->n)
+		blocks.push_commit();
+	blk = NULL;
+	stopping = true;
+	thread.join();
+	running = false;
+	if (hash_file)
+		fclose(hash_file);
+	if (wav) {
+		write_wav_header(wav, wav_samples, 2);
+		fclose(wav);
+	}
+	hash_file = NULL;
+	wav = NULL;
+	printf("HDMI: %llu frames, %llu audio samples, %llu packets, %llu errors, sim waited for the decoder %llu times\n",
+	       (unsigned long long)frames, (unsigned long long)samples, (unsigned long long)packets,
+	       (unsigned long long)errors, (unsigned long long)stalls);
+}
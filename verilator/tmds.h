@@ -0,0 +1,109 @@
+#pragma once
+
+// HDMI output decoding for the HDMI build (make HDMI=1, sim_main -V/-W/-X).
+//
+// In that build nes2hdmi and the hdmi2 core are part of the model, clocked by a
+// 74.25 MHz pixel clock from the harness. Every pixel clock the sim thread stores
+// the three 10-bit TMDS symbols (hdmi.tmds_internal, what the serializer would
+// send). A writer thread decodes them the way a sink does:
+//   - control periods give hsync and vsync
+//   - video data periods are TMDS decoded into 1280x720 RGB frames
+//   - data islands are TERC4 decoded into packets, which are ECC checked.
+//     Audio sample packets give the 48 kHz stereo audio.
+// Frames are counted from the first complete one after the decoder starts.
+// Symbols that fit none of the periods, bad packet ECC and video lines that are
+// not 1280 pixels long are counted as errors, from the first vsync on.
+//
+// Video decoding goes through lookup tables, with AVX2 gathers when the CPU has
+// them. Like the CPU trace, decoding is lossless: if the decoder falls behind,
+// the sim waits for it.
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "ring.h"
+
+const int HDMI_W = 1280;
+const int HDMI_H = 720;
+
+class TmdsDecoder {
+public:
+	static const int BLOCK = 65536;
+	struct Block {
+		int n;
+		uint32_t s[BLOCK];      // channel 0 | channel 1 << 10 | channel 2 << 20
+	};
+
+	// frames: write these decoded frames as PPM to out_dir, hash_path: write a hash
+	// of every frame, wav_path: write the audio. Any of them can be empty/NULL.
+	bool start(const std::vector<std::pair<long long,long long>> &frames, const std::string &out_dir,
+	           const char *hash_path, const char *wav_path);
+	void stop();
+	bool active() const { return running; }
+
+	// one pixel clock
+	void push(const uint16_t *tmds) {
+		if (!blk) {
+			while (!(blk = blocks.push_slot())) {
+				stalls++;
+				std::this_thread::yield();
+			}
+			blk->n = 0;
+		}
+		blk->s[blk->n++] = tmds[0] | tmds[1] << 10 | (uint32_t)tmds[2] << 20;
+		if (blk->n == BLOCK) {
+			blocks.push_commit();
+			blk = NULL;
+		}
+	}
+
+	// written by the decoder thread, final after stop()
+	std::atomic<uint64_t> frames{0};        // complete frames decoded
+	std::atomic<uint64_t> samples{0};       // stereo audio samples
+	std::atomic<uint64_t> packets{0};       // data island packets
+	std::atomic<uint64_t> errors{0};
+	uint64_t stalls = 0;                    // times the sim waited for the decoder
+	int frames_written = 0;
+
+private:
+	enum Period { CONTROL, VIDEO_GUARD, VIDEO, ISLAND_GUARD, ISLAND, ISLAND_END };
+
+	void worker();
+	void decode(const uint32_t *s, int n);
+	void error() { if (synced) errors++; }      // not before the first frame
+	void set_vsync(bool v);
+	void end_line();
+	void end_frame();
+	void packet();
+
+	bool running = false;
+	Block *blk = NULL;
+	SpscRing<Block, 16> blocks;
+	std::atomic<bool> stopping{false};
+	std::thread thread;
+
+	// decoder state
+	Period period = CONTROL;
+	int guard_n = 0;                        // guard band symbols so far
+	bool vsync = false;
+	int vsync_idle = -1;                    // vsync level in video periods, -1 before the first
+	bool synced = false;                    // seen a frame start
+	int x = 0, y = 0;
+	std::vector<uint32_t> frame;            // 0x00RRGGBB
+	int pos = 0;                            // pixel within the packet
+	uint32_t header;
+	uint64_t sub[4];
+
+	// outputs
+	std::vector<std::pair<long long,long long>> dump;
+	std::string out_dir;
+	FILE *hash_file = NULL;
+	FILE *wav = NULL;
+	uint32_t wav_samples = 0;
+	std::vector<int16_t> audio_buf;         // left, right
+};
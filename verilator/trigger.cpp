@@ -0,0 +1,240 @@
+// Triggered, windowed FST tracing. See trigger.h for the config format.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <sys/stat.h>
+
+#include "verilated.h"
+#include "verilated_syms.h"
+#include "trigger.h"
+
+using namespace std;
+
+static bool parse_u64(const string &s, uint64_t &v) {
+	char *end;
+	v = strtoull(s.c_str(), &end, 0);
+	return !s.empty() && *end == 0;
+}
+
+static bool parse_cond(const vector<string> &w, TraceCond &c, bool is_stop, string &err) {
+	uint64_t v;
+	size_t n = w.size();
+	if (n >= 3 && w[1] == "frame" && parse_u64(w[2], v)) {
+		c.kind = TraceCond::FRAME;
+		c.frame = v;
+		if (n == 5 && w[3] == "scanline" && parse_u64(w[4], v))
+			c.scanline = v;
+		else if (n != 3) {
+			err = "expecting frame N [scanline S]";
+			return false;
+		}
+	} else if (n == 3 && w[1] == "scanline" && parse_u64(w[2], v)) {
+		c.kind = TraceCond::FRAME;
+		c.scanline = v;
+	} else if ((n == 3 || n == 4) && w[1] == "cpu" && parse_u64(w[2], v)) {
+		c.kind = TraceCond::CPU;
+		c.addr = v;
+		if (n == 4 && (w[3] == "read" || w[3] == "write"))
+			c.rw = w[3] == "read" ? 1 : 2;
+		else if (n == 4) {
+			err = "expecting cpu ADDR [read|write]";
+			return false;
+		}
+	} else if ((n == 4 || n == 5) && w[1] == "signal" && parse_u64(w[3], c.value)) {
+		c.kind = TraceCond::SIGNAL;
+		c.var = w[2];
+		if (n == 5 && !parse_u64(w[4], c.mask)) {
+			err = "cannot parse mask " + w[4];
+			return false;
+		}
+		c.value &= c.mask;
+	} else if (is_stop && n == 3 && w[1] == "after" && parse_u64(w[2], v)) {
+		c.kind = TraceCond::AFTER;
+		c.frames = v;
+	} else {
+		err = "unknown condition";
+		return false;
+	}
+	return true;
+}
+
+bool TraceTrigger::load(const char *fname, string &err) {
+	ifstream f(fname);
+	if (!f) {
+		err = string("cannot open ") + fname;
+		return false;
+	}
+	string line;
+	int lineno = 0;
+	while (getline(f, line)) {
+		lineno++;
+		line = line.substr(0, line.find('#'));
+		istringstream ss(line);
+		vector<string> w;
+		string t;
+		while (ss >> t)
+			w.push_back(t);
+		if (w.empty())
+			continue;
+		uint64_t v;
+		bool ok = true;
+		if (w[0] == "depth" && w.size() == 2 && parse_u64(w[1], v))
+			depth = v;
+		else if (w[0] == "scope" && w.size() == 2)
+			scopes.push_back(make_pair(w[1], -1));     // depth, resolved in start()
+		else if (w[0] == "scope" && w.size() == 3 && parse_u64(w[2], v))
+			scopes.push_back(make_pair(w[1], (int)v));
+		else if (w[0] == "history" && w.size() == 2 && parse_u64(w[1], v))
+			history = v;
+		else if (w[0] == "rearm" && w.size() == 1)
+			rearm = true;
+		else if (w[0] == "start")
+			ok = parse_cond(w, start_cond, false, err);
+		else if (w[0] == "stop")
+			ok = parse_cond(w, stop_cond, true, err);
+		else {
+			ok = false;
+			err = "unknown directive";
+		}
+		if (!ok) {
+			err = string(fname) + ":" + to_string(lineno) + ": " + (err.empty() ? "syntax error" : err);
+			return false;
+		}
+	}
+	return true;
+}
+
+// Find a public signal by its hierarchical name, e.g. TOP.nestang_top.nes.color
+static bool resolve_signal(Vnestang_top *top, TraceCond &c, string &err) {
+	if (c.kind != TraceCond::SIGNAL)
+		return true;
+	string name = c.var.compare(0, 4, "TOP.") == 0 ? c.var : "TOP." + c.var;
+	size_t dot = name.rfind('.');
+	const VerilatedScope *scope = top->contextp()->scopeFind(name.substr(0, dot).c_str());
+	const VerilatedVar *var = scope ? scope->varFind(name.substr(dot + 1).c_str()) : NULL;
+	if (!var) {
+		err = "no public signal " + name + " (needs /* verilator public */)";
+		return false;
+	}
+	switch (var->vltype()) {
+	case VLVT_UINT8: c.bytes = 1; break;
+	case VLVT_UINT16: c.bytes = 2; break;
+	case VLVT_UINT32: c.bytes = 4; break;
+	case VLVT_UINT64: c.bytes = 8; break;
+	default:
+		err = name + " is wider than 64 bits";
+		return false;
+	}
+	if (var->udims()) {
+		err = name + " is an array";
+		return false;
+	}
+	c.datap = var->datap();
+	return true;
+}
+
+bool TraceTrigger::start(Vnestang_top *t, const string &out_dir, long long frame, string &err) {
+	top = t;
+	dir = out_dir;
+	if (!resolve_signal(top, start_cond, err) || !resolve_signal(top, stop_cond, err))
+		return false;
+
+	Verilated::traceEverOn(true);
+	fst = new VerilatedFstC;
+	for (auto &s : scopes)
+		fst->dumpvars(s.second < 0 ? depth : s.second, s.first);
+	top->trace(fst, scopes.empty() ? depth : 99);
+	wait_start(frame);
+	return true;
+}
+
+void TraceTrigger::finish() {
+	close_chunk();
+	done = true;
+	dumping = false;
+}
+
+void TraceTrigger::open_chunk(const char *prefix, long long frame) {
+	char fname[32];
+	snprintf(fname, sizeof(fname), "/%s_%05lld.fst", prefix, frame);
+	cur = dir + fname;
+	fst->open(cur.c_str());
+	dumping = true;
+}
+
+void TraceTrigger::close_chunk() {
+	if (cur.empty())
+		return;
+	fst->close();
+	struct stat st;
+	if (stat(cur.c_str(), &st) == 0)
+		closed_bytes += st.st_size;
+	cur.clear();
+	dumping = false;
+}
+
+// Waiting for the start condition, recording history if asked to
+void TraceTrigger::wait_start(long long frame) {
+	active = false;
+	if (start_cond.kind == TraceCond::NONE)
+		fire(frame);
+	else if (history > 0) {
+		open_chunk("pre", frame);
+		chunks.push_back(cur);
+	}
+}
+
+void TraceTrigger::fire(long long frame) {
+	close_chunk();
+	if (!active) {
+		// pre-trigger chunks on disk now belong to this window
+		chunks.clear();
+		open_chunk("trace", frame);
+		active = true;
+		window_start = frame;
+		printf("Trace window opened at frame %lld\n", frame);
+	} else {
+		printf("Trace window closed at frame %lld\n", frame);
+		if (rearm)
+			wait_start(frame);
+		else
+			done = true;
+	}
+}
+
+void TraceTrigger::scanline(long long frame, int line) {
+	const TraceCond &c = active ? stop_cond : start_cond;
+	if (!done && c.kind == TraceCond::FRAME && c.scanline == line && (c.frame < 0 || c.frame == frame))
+		fire(frame);
+}
+
+void TraceTrigger::frame(long long frame) {
+	if (done)
+		return;
+	const TraceCond &c = active ? stop_cond : start_cond;
+	if ((c.kind == TraceCond::FRAME && c.scanline < 0 && c.frame == frame) ||
+	    (c.kind == TraceCond::AFTER && frame - window_start >= c.frames)) {
+		fire(frame);
+		return;
+	}
+	if (!active && history > 0) {
+		// rotate pre-trigger chunks, keeping the last `history` complete frames
+		close_chunk();
+		while ((int)chunks.size() > history) {
+			remove(chunks.front().c_str());
+			chunks.erase(chunks.begin());
+		}
+		open_chunk("pre", frame);
+		chunks.push_back(cur);
+	}
+}
+
+uint64_t TraceTrigger::bytes_written() const {
+	struct stat st;
+	if (!cur.empty() && stat(cur.c_str(), &st) == 0)
+		return closed_bytes + st.st_size;
+	return closed_bytes;
+}
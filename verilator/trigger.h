@@ -0,0 +1,106 @@
+#pragma once
+
+// Triggered, windowed FST tracing (sim_main -T config).
+//
+// Config file, one directive per line, # starts a comment:
+//   depth N                   trace depth below the selected scopes (default 5)
+//   scope HIER [N]            only trace HIER, e.g. TOP.nestang_top.nes.ppu, N levels
+//                             deep (default depth, 0 for all) (repeatable)
+//   history N                 keep N frames of pre-trigger trace as rotating chunk files
+//   start COND                open the trace window when COND happens
+//   stop COND                 close it when COND happens
+//   rearm                     wait for the start condition again after each window
+//
+// COND is one of
+//   frame N [scanline S]      frame N completes [and the PPU then starts scanline S]
+//   scanline S                the PPU starts scanline S, in any frame
+//   cpu ADDR [read|write]     the CPU bus accesses ADDR
+//   signal HIER.VAR VALUE [MASK]   a /* verilator public */ signal equals VALUE
+//   after N                   (stop only) N frames after the window opened
+//
+// Without a start condition the window opens right away. Without a stop condition
+// it stays open until the run ends. Pre-trigger chunks are pre_<frame>.fst, windows
+// are trace_<frame>.fst, both in the -o directory.
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Vnestang_top.h"
+#include "Vnestang_top_NES.h"
+#include <verilated_fst_c.h>
+
+struct TraceCond {
+	enum Kind { NONE, FRAME, CPU, SIGNAL, AFTER } kind = NONE;
+	long long frame = -1;           // FRAME, -1 for any
+	int scanline = -1;              // FRAME, -1 for the frame boundary
+	uint16_t addr = 0;              // CPU
+	int rw = 0;                     // CPU: 0 any, 1 read, 2 write
+	std::string var;                // SIGNAL
+	const void *datap = NULL;
+	int bytes = 0;
+	uint64_t value = 0, mask = ~0ULL;
+	long long frames = 0;           // AFTER
+
+	bool on_clock() const { return kind == CPU || kind == SIGNAL; }
+
+	bool clock_match(const Vnestang_top_NES *nes) const {
+		if (kind == CPU)
+			return nes->cpu_ce && nes->addr == addr &&
+			       (rw == 0 || (rw == 2) == (bool)nes->mw_int);
+		uint64_t v = 0;
+		switch (bytes) {
+		case 1: v = *(const uint8_t *)datap; break;
+		case 2: v = *(const uint16_t *)datap; break;
+		case 4: v = *(const uint32_t *)datap; break;
+		default: v = *(const uint64_t *)datap; break;
+		}
+		return (v & mask) == value;
+	}
+};
+
+class TraceTrigger {
+public:
+	bool load(const char *fname, std::string &err);
+	// attach to the model, look up signals and start waiting for the trigger
+	bool start(Vnestang_top *top, const std::string &dir, long long frame, std::string &err);
+	void finish();
+
+	bool dumping = false;           // dump() this step
+	void dump(uint64_t t) { fst->dump(t); }
+
+	// called on every rising edge, cheap unless a cpu/signal condition is armed
+	void clock(const Vnestang_top_NES *nes, long long frame) {
+		const TraceCond *c = active ? &stop_cond : &start_cond;
+		if (!done && c->on_clock() && c->clock_match(nes))
+			fire(frame);
+	}
+	bool wants_scanlines() const {
+		return start_cond.scanline >= 0 || stop_cond.scanline >= 0;
+	}
+	void scanline(long long frame, int line);
+	void frame(long long frame);
+	uint64_t bytes_written() const;        // all chunks so far, including deleted ones
+
+private:
+	void wait_start(long long frame);
+	void fire(long long frame);
+	void open_chunk(const char *prefix, long long frame);
+	void close_chunk();
+
+	int depth = 5;
+	std::vector<std::pair<std::string,int>> scopes;     // HIER and levels, -1 for depth
+	int history = 0;
+	bool rearm = false;
+	TraceCond start_cond, stop_cond;
+
+	Vnestang_top *top = NULL;
+	VerilatedFstC *fst = NULL;
+	std::string dir;
+	bool active = false;            // inside a trace window
+	bool done = false;              // window closed and not rearmed
+	long long window_start = 0;
+	std::vector<std::string> chunks;        // pre-trigger chunk files, oldest first
+	std::string cur;                // file being written, empty if none
+	uint64_t closed_bytes = 0;      // size of chunks already closed
+};
@@ -0,0 +1,126 @@
+// Frame conversion for the simulator.
+// The sim loop only records raw 6-bit color indices, once per PPU dot. They are turned
+// into RGBA here, a whole frame at a time and only when the frame is actually shown
+// or written out.
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <zlib.h>
+
+#include "video.h"
+#include "nes_palette.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define HAVE_AVX2_PATH
+#endif
+
+// Pixel is {a,b,g,r} in memory, i.e. 0xRRGGBBAA as a little-endian word
+static struct PaletteLut {
+	uint32_t c[64];
+	PaletteLut() {
+		for (int i = 0; i < 64; i++)
+			c[i] = (NES_PALETTE[i] << 8) | 0xff;
+	}
+} lut;
+
+static void convert_pixels_scalar(uint32_t *dst, const uint8_t *idx, int n) {
+	for (int i = 0; i < n; i++)
+		dst[i] = lut.c[idx[i] & 63];
+}
+
+#ifdef HAVE_AVX2_PATH
+__attribute__((target("avx2")))
+static void convert_pixels_avx2(uint32_t *dst, const uint8_t *idx, int n) {
+	const __m256i mask = _mm256_set1_epi32(63);
+	int i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m256i ix = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(idx + i)));
+		ix = _mm256_and_si256(ix, mask);
+		__m256i px = _mm256_i32gather_epi32((const int *)lut.c, ix, 4);
+		_mm256_storeu_si256((__m256i *)(dst + i), px);
+	}
+	convert_pixels_scalar(dst + i, idx + i, n - i);
+}
+#endif
+
+void convert_pixels(Pixel *dst, const uint8_t *idx, int n) {
+	uint32_t *d = (uint32_t *)dst;
+#ifdef HAVE_AVX2_PATH
+	static const bool avx2 = __builtin_cpu_supports("avx2");
+	if (avx2) {
+		convert_pixels_avx2(d, idx, n);
+		return;
+	}
+#endif
+	convert_pixels_scalar(d, idx, n);
+}
+
+bool write_ppm(const char *fname, const Pixel *buf) {
+	FILE *f = fopen(fname, "wb");
+	if (!f)
+		return false;
+	fprintf(f, "P6\n%d %d\n255\n", H_RES, V_RES);
+	uint8_t line[H_RES*3];
+	for (int y = 0; y < V_RES; y++) {
+		for (int x = 0; x < H_RES; x++) {
+			const Pixel *p = &buf[y*H_RES + x];
+			line[x*3] = p->r;
+			line[x*3+1] = p->g;
+			line[x*3+2] = p->b;
+		}
+		fwrite(line, 1, sizeof(line), f);
+	}
+	return fclose(f) == 0;
+}
+
+// PNG chunk: big-endian length, type, data, CRC over type and data
+static void png_chunk(FILE *f, const char *type, const uint8_t *data, uint32_t n) {
+	uint8_t len[4] = {(uint8_t)(n >> 24), (uint8_t)(n >> 16), (uint8_t)(n >> 8), (uint8_t)n};
+	fwrite(len, 1, 4, f);
+	fwrite(type, 1, 4, f);
+	fwrite(data, 1, n, f);
+	uLong crc = crc32(crc32(0, (const Bytef *)type, 4), data, n);
+	uint8_t c[4] = {(uint8_t)(crc >> 24), (uint8_t)(crc >> 16), (uint8_t)(crc >> 8), (uint8_t)crc};
+	fwrite(c, 1, 4, f);
+}
+
+bool write_png(const char *fname, const Pixel *buf, int w, int h) {
+	// 8-bit RGB rows, each after a filter type byte of 0
+	std::vector<uint8_t> raw((size_t)(w*3 + 1) * h);
+	uint8_t *r = raw.data();
+	for (int y = 0; y < h; y++) {
+		*r++ = 0;
+		for (int x = 0; x < w; x++) {
+			const Pixel *p = &buf[y*w + x];
+			*r++ = p->r;
+			*r++ = p->g;
+			*r++ = p->b;
+		}
+	}
+	uLongf zn = compressBound(raw.size());
+	std::vector<uint8_t> z(zn);
+	if (compress2(z.data(), &zn, raw.data(), raw.size(), Z_BEST_SPEED) != Z_OK)
+		return false;
+	FILE *f = fopen(fname, "wb");
+	if (!f)
+		return false;
+	fwrite("\x89PNG\r\n\x1a\n", 1, 8, f);
+	uint8_t ihdr[13] = {(uint8_t)(w >> 24), (uint8_t)(w >> 16), (uint8_t)(w >> 8), (uint8_t)w,
+	                    (uint8_t)(h >> 24), (uint8_t)(h >> 16), (uint8_t)(h >> 8), (uint8_t)h,
+	                    8, 2, 0, 0, 0};    // 8 bits, RGB, deflate, no filter, no interlace
+	png_chunk(f, "IHDR", ihdr, sizeof(ihdr));
+	png_chunk(f, "IDAT", z.data(), zn);
+	png_chunk(f, "IEND", ihdr, 0);          // crc32() needs a non-NULL pointer
+	return fclose(f) == 0;
+}
+
+uint64_t frame_hash(const uint8_t *idx, int n) {
+	uint64_t h = 0xcbf29ce484222325ULL;
+	for (int i = 0; i < n; i++) {
+		h ^= idx[i];
+		h *= 0x100000001b3ULL;
+	}
+	return h;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdint>
+
+// See: https://projectf.io/posts/verilog-sim-verilator-sdl/
+const int H_RES = 256;
+const int V_RES = 240;
+
+typedef struct Pixel {  // for SDL texture
+    uint8_t a;  // transparency
+    uint8_t b;  // blue
+    uint8_t g;  // green
+    uint8_t r;  // red
+} Pixel;
+
+// Convert n 6-bit NES color indices to RGBA pixels through a 64-entry LUT.
+// Uses AVX2 gathers when the CPU has them.
+void convert_pixels(Pixel *dst, const uint8_t *idx, int n);
+
+// write a frame of pixels as binary PPM (P6)
+bool write_ppm(const char *fname, const Pixel *buf);
+
+// write w x h pixels as an RGB PNG
+bool write_png(const char *fname, const Pixel *buf, int w, int h);
+
+// 64-bit FNV-1a hash of a frame of color indices, for golden-frame regression
+uint64_t frame_hash(const uint8_t *idx, int n);